@@ -1,6 +1,5 @@
 #include "stdafx.h"
 
-#include <File.h>
 #include <Path.h>
 
 #include <RestClient.h>
@@ -13,9 +12,10 @@ public:
 
     AsyncFileDownloader(const AsyncFileDownloader&) = delete;
 
+    // Includes what a previous, interrupted attempt left on disk
     size_t GetDownloadCount() const
     {
-        return m_DownloadLength.load(std::memory_order_relaxed);
+        return static_cast<size_t>(GetResumeOffset()) + m_DownloadLength.load(std::memory_order_relaxed);
     }
 
 private: // From AsyncRestClient
@@ -48,13 +48,19 @@ bool Download(std::string& content, const char* url)
     return true;
 }
 
-void AsyncDownload(const char* url, AsyncFileDownloader* downloader)
+// Streams to "path" (via "path.part", resumed if a previous attempt was interrupted) rather than into memory.
+bool AsyncDownload(const char* url, const std::filesystem::path& path, AsyncFileDownloader* downloader)
 {
+    if (!downloader->SetDownloadFile(path)) {
+        fwprintf(stderr, L"Failed to open '%s.part' for writing\n", path.wstring().c_str());
+        return false;
+    }
     downloader->SetUrl(url);
     downloader->SetVerifyPeer(false);
     downloader->SetFollowLocation(true);
     downloader->SetUserAgent("curl/7.71.1");
     downloader->ExecuteAsync();
+    return true;
 }
 
 struct Asset {
@@ -226,7 +232,9 @@ bool DownloadWindow::DownloadAllFiles()
     window.SetChangelog(release.body.c_str(), release.body.size());
 
     AsyncFileDownloader downloader;
-    AsyncDownload(url.c_str(), &downloader);
+    if (!AsyncDownload(url.c_str(), dll_path, &downloader)) {
+        return false;
+    }
 
     while (!window.ShouldClose()) {
         window.PollMessages(16);
@@ -243,12 +251,7 @@ bool DownloadWindow::DownloadAllFiles()
                 return false;
             }
 
-            std::string& file_content = downloader.GetContent();
-            if (!WriteEntireFile(dll_path.wstring().c_str(), file_content.c_str(), file_content.size())) {
-                fwprintf(stderr, L"WriteEntireFile failed on '%s' with %zu bytes\n",
-                         dll_path.wstring().c_str(), file_content.size());
-                return false;
-            }
+            // Already streamed to dll_path
 
             downloader.Clear();
             SendMessageW(window.m_hProgressBar, PBM_SETPOS, 100, 0);
@@ -19,6 +19,8 @@
 #include <Logger.h>
 
 #include <Modules/Resources.h>
+#include <Modules/HttpCache.h>
+#include <Modules/TextureResidency.h>
 #include <Modules/ChatCommands.h>
 #include <Modules/ToolboxTheme.h>
 #include <Modules/ToolboxSettings.h>
@@ -793,6 +795,7 @@ void GWToolbox::Draw(IDirect3DDevice9* device)
 
     // Draw loop
     Resources::DxUpdate(device);
+    TextureResidency::DxUpdate(device);
 
     ImGui_ImplDX9_NewFrame();
     ImGui_ImplWin32_NewFrame();
@@ -827,6 +830,8 @@ void GWToolbox::Draw(IDirect3DDevice9* device)
 
     ImGui::EndFrame();
     ImGui::Render();
+    Resources::RecordDrawCalls(ImGui::GetDrawData());
+    TextureResidency::MarkDrawn(ImGui::GetDrawData());
     ImGui_ImplDX9_RenderDrawData(ImGui::GetDrawData());
 }
 
@@ -863,7 +868,10 @@ void GWToolbox::UpdateInitialising(float) {
 
     Log::Log("Creating Modules\n");
     ToggleModule(CrashHandler::Instance());
+    // Before Resources and GwDatTextureModule, so it's terminated before the textures it tracks are freed
+    ToggleModule(TextureResidency::Instance());
     ToggleModule(Resources::Instance());
+    ToggleModule(HttpCache::Instance());
     ToggleModule(ToolboxTheme::Instance());
     ToggleModule(ItemDescriptionHandler::Instance());
     ToggleModule(ToolboxSettings::Instance());
@@ -2,6 +2,8 @@
 #include "stdafx.h"
 
 #include <ImGuiAddons.h>
+#include <Modules/TextureResidency.h>
+#include <Utils/TextureAtlas.h>
 #include <string>
 
 namespace ImGui {
@@ -146,10 +148,10 @@ namespace ImGui {
             if (!icons[i])
                 continue;
             if (uv0.x == uv1.x && uv0.y == uv1.y) {
-                GetWindowDrawList()->AddImage(icons[i], top_left, bottom_right, uv0, CalculateUvCrop(icons[i], img_size));
+                AddImageAtlased(GetWindowDrawList(), icons[i], top_left, bottom_right, uv0, CalculateUvCrop(icons[i], img_size));
             }
             else {
-                GetWindowDrawList()->AddImage(icons[i], top_left, bottom_right, uv0, uv1);
+                AddImageAtlased(GetWindowDrawList(), icons[i], top_left, bottom_right, uv0, uv1);
             }
         }
         if (label) {
@@ -338,15 +340,29 @@ namespace ImGui {
         return true;
     }
 
+    void AddImageAtlased(ImDrawList* draw_list, ImTextureID user_texture_id, const ImVec2& top_left, const ImVec2& bottom_right, ImVec2 uv0, ImVec2 uv1)
+    {
+        // Atlased icons only show up as their page in the draw data; tell residency about the icon itself
+        TextureResidency::MarkDrawn(user_texture_id);
+        // Neighbouring icons on the same page then share a draw call
+        TextureAtlas::Remap(user_texture_id, uv0, uv1);
+        draw_list->AddImage(user_texture_id, top_left, bottom_right, uv0, uv1);
+    }
+
     void ImageCropped(const ImTextureID user_texture_id, const ImVec2& size)
     {
-        Image(user_texture_id, size, {0, 0}, CalculateUvCrop(user_texture_id, size));
+        ImTextureID texture = user_texture_id;
+        ImVec2 uv0 = {0, 0};
+        ImVec2 uv1 = CalculateUvCrop(user_texture_id, size);
+        TextureResidency::MarkDrawn(user_texture_id);
+        TextureAtlas::Remap(texture, uv0, uv1);
+        Image(texture, size, uv0, uv1);
     }
 
     void AddImageCropped(const ImTextureID user_texture_id, const ImVec2& top_left, const ImVec2& bottom_right)
     {
         const ImVec2 size = {bottom_right.x - top_left.x, bottom_right.y - top_left.y};
-        GetWindowDrawList()->AddImage(user_texture_id, top_left, bottom_right, {0, 0}, CalculateUvCrop(user_texture_id, size));
+        AddImageAtlased(GetWindowDrawList(), user_texture_id, top_left, bottom_right, {0, 0}, CalculateUvCrop(user_texture_id, size));
     }
 
     bool ColorPalette(const char* label, size_t* palette_index, const ImVec4* palette, const size_t count, const size_t max_per_line, const ImGuiColorEditFlags flags)
@@ -35,6 +35,8 @@ namespace ImGui {
     IMGUI_API bool ColorButtonPicker(const char*, Color*, ImGuiColorEditFlags = 0);
     // Add cropped image to current window
     IMGUI_API void ImageCropped(ImTextureID user_texture_id, const ImVec2& size);
+    // Add image to draw list; icons packed into the TextureAtlas are drawn from their atlas page instead
+    IMGUI_API void AddImageAtlased(ImDrawList* draw_list, ImTextureID user_texture_id, const ImVec2& top_left, const ImVec2& bottom_right, ImVec2 uv0 = {0, 0}, ImVec2 uv1 = {1, 1});
     // Add cropped image to window draw list
     IMGUI_API void AddImageCropped(ImTextureID user_texture_id, const ImVec2& top_left, const ImVec2& bottom_right);
     // Calculate the end position of a crop box for the given texture to fit into the given size
@@ -19,6 +19,7 @@
 #include <GWCA/GameEntities/Friendslist.h>
 #include <Utils/ToolboxUtils.h>
 #include <Utils/GuiUtils.h>
+#include <Utils/AhoCorasick.h>
 
 #include "GWToolbox.h"
 #include "GWCA/Managers/PlayerMgr.h"
@@ -78,10 +79,19 @@ namespace {
 
     // Chat filter
     std::vector<std::wstring> bycontent_words;
+    // bycontent_words compiled into one automaton, so a message is scanned once however many words there are
+    AhoCorasick bycontent_matcher;
     char bycontent_word_buf[FILTER_BUF_SIZE] = "";
     bool bycontent_filedirty = false;
 
-    std::vector<std::wregex> bycontent_regex;
+    struct ContentRegex {
+        std::wstring pattern;
+        std::regex_constants::syntax_option_type flags;
+        std::wregex regex;
+    };
+    std::vector<ContentRegex> bycontent_regex;
+    // What's actually searched: regexes that can be merged are joined into one alternation, the rest are kept as they are
+    std::vector<std::wregex> bycontent_regex_compiled;
     char bycontent_regex_buf[FILTER_BUF_SIZE] = "";
 
 #ifdef EXTENDED_IGNORE_LIST
@@ -160,22 +170,89 @@ namespace {
 
 
 
+    // Strip diacritics from str into sanitized, and lower case that into lowercase.
+    // The outputs are reused between calls, so once they've grown to fit a long message this doesn't allocate.
+    void NormaliseContent(const std::wstring_view str, std::wstring& sanitized, std::wstring& lowercase)
+    {
+        GuiUtils::RemoveDiacritics(str, sanitized);
+        GuiUtils::ToLower(sanitized, lowercase);
+    }
+
     void ParseBuffer(const char* text, std::vector<std::wstring>& words)
     {
         using namespace GuiUtils;
         words.clear();
-        const auto text_ws = RemoveDiacritics(ToLower(StringToWString(text)));
+        const auto text_ws = StringToWString(text);
         std::wstringstream stream(text_ws.c_str());
         std::wstring word;
+        std::wstring sanitized;
+        std::wstring lowercase;
         while (std::getline(stream, word)) {
             if (word.empty()) {
                 continue;
             }
-            words.push_back(word);
+            // Same normalisation as the messages they're matched against
+            NormaliseContent(word, sanitized, lowercase);
+            words.push_back(lowercase);
+        }
+    }
+
+    // ECMAScript regexes without backreferences can be wrapped in (?:...) and joined with | without changing what they match
+    bool CanMergeRegex(const ContentRegex& r)
+    {
+        using namespace std::regex_constants;
+        if (r.flags & (basic | extended | awk | grep | egrep)) {
+            return false;
+        }
+        for (size_t i = 0; i + 1 < r.pattern.size(); i++) {
+            if (r.pattern[i] != L'\\') {
+                continue;
+            }
+            if (r.pattern[i + 1] >= L'1' && r.pattern[i + 1] <= L'9') {
+                return false;
+            }
+            i++; // Skip whatever was escaped
+        }
+        return true;
+    }
+
+    // One std::wregex per set of flags instead of one per line, so regex_search walks the message once per set.
+    void CompileRegexes(const std::vector<ContentRegex>& regexes, std::vector<std::wregex>& compiled)
+    {
+        compiled.clear();
+        std::map<std::regex_constants::syntax_option_type, std::vector<const ContentRegex*>> groups;
+        for (const auto& r : regexes) {
+            if (CanMergeRegex(r)) {
+                groups[r.flags].push_back(&r);
+            }
+            else {
+                compiled.push_back(r.regex);
+            }
+        }
+        for (const auto& [flags, group] : groups) {
+            if (group.size() == 1) {
+                compiled.push_back(group[0]->regex);
+                continue;
+            }
+            std::wstring alternation;
+            for (const auto r : group) {
+                if (!alternation.empty()) {
+                    alternation += L'|';
+                }
+                alternation += L"(?:" + r->pattern + L")";
+            }
+            try {
+                compiled.emplace_back(alternation, flags | std::regex_constants::nosubs);
+            } catch (const std::regex_error&) {
+                // Shouldn't happen, since each one compiled on its own; search them separately if it does
+                for (const auto r : group) {
+                    compiled.push_back(r->regex);
+                }
+            }
         }
     }
 
-    void ParseBuffer(const char* text, std::vector<std::wregex>& regex)
+    void ParseBuffer(const char* text, std::vector<ContentRegex>& regex)
     {
         using namespace GuiUtils;
         regex.clear();
@@ -225,10 +302,10 @@ namespace {
                                 break;
                         }
                     }
-                    regex.emplace_back(regex_str, regex_flags);
+                    regex.emplace_back(regex_str, regex_flags, std::wregex(regex_str, regex_flags));
                 }
                 else {
-                    regex.emplace_back(word, std::regex_constants::optimize);
+                    regex.emplace_back(word, std::regex_constants::optimize, std::wregex(word, std::regex_constants::optimize));
                 }
             } catch (const std::regex_error&) {
                 Log::Warning("Cannot parse regular expression '%s'", word.c_str());
@@ -654,19 +731,17 @@ namespace {
             end = &message[i];
         }
 
-        using namespace GuiUtils;
-        const auto str = std::wstring(start, end);
+        const auto str = std::wstring_view(start, end);
         if (str.empty()) {
             return false;
         }
-        const auto sanitized = RemoveDiacritics(str);
-        const auto lowercase = ToLower(sanitized);
-        for (const auto& s : bycontent_words) {
-            if (lowercase.find(s) != std::wstring::npos) {
-                return true;
-            }
+        static std::wstring sanitized;
+        static std::wstring lowercase;
+        NormaliseContent(str, sanitized, lowercase);
+        if (bycontent_matcher.Contains(lowercase)) {
+            return true;
         }
-        for (const auto& r : bycontent_regex) {
+        for (const auto& r : bycontent_regex_compiled) {
             if (std::regex_search(sanitized, r)) {
                 return true;
             }
@@ -887,6 +962,7 @@ void ChatFilter::LoadSettings(ToolboxIni* ini)
         file1.get(bycontent_word_buf, FILTER_BUF_SIZE, '\0');
         file1.close();
         ParseBuffer(bycontent_word_buf, bycontent_words);
+        bycontent_matcher.Build(bycontent_words);
     }
     std::ifstream file2;
     file2.open(Resources::GetSettingFile(L"FilterByContent_regex.txt"));
@@ -894,6 +970,7 @@ void ChatFilter::LoadSettings(ToolboxIni* ini)
         file2.get(bycontent_regex_buf, FILTER_BUF_SIZE, '\0');
         file2.close();
         ParseBuffer(bycontent_regex_buf, bycontent_regex);
+        CompileRegexes(bycontent_regex, bycontent_regex_compiled);
     }
 
 #ifdef EXTENDED_IGNORE_LIST
@@ -959,12 +1036,14 @@ void ChatFilter::SaveSettings(ToolboxIni* ini)
     if (timer_parse_filters) {
         timer_parse_filters = 0;
         ParseBuffer(bycontent_word_buf, bycontent_words);
+        bycontent_matcher.Build(bycontent_words);
         bycontent_filedirty = true;
     }
 
     if (timer_parse_regexes) {
         timer_parse_regexes = 0;
         ParseBuffer(bycontent_regex_buf, bycontent_regex);
+        CompileRegexes(bycontent_regex, bycontent_regex_compiled);
         bycontent_filedirty = true;
     }
 
@@ -1163,12 +1242,14 @@ void ChatFilter::Update(const float)
     if (timer_parse_filters && timer_parse_filters < timestamp) {
         timer_parse_filters = 0;
         ParseBuffer(bycontent_word_buf, bycontent_words);
+        bycontent_matcher.Build(bycontent_words);
         bycontent_filedirty = true;
     }
 
     if (timer_parse_regexes && timer_parse_regexes < timestamp) {
         timer_parse_regexes = 0;
         ParseBuffer(bycontent_regex_buf, bycontent_regex);
+        CompileRegexes(bycontent_regex, bycontent_regex_compiled);
         bycontent_filedirty = true;
     }
 }
@@ -43,8 +43,6 @@ namespace {
     };
 
 
-    size_t recv_count = 0;
-    size_t sent_count = 0;
     std::wstring account;
     bool injecting = false;
     bool enabled = true;
@@ -61,38 +59,113 @@ namespace {
     GW::HookEntry PostAddToChatLog_entry;
     GW::HookEntry UIMessage_Entry;
 
-    struct TBChatMessage {
-        TBChatMessage* next{};
-        TBChatMessage* prev{};
-        std::wstring msg;
-        uint32_t channel;
-        FILETIME timestamp{};
+    // Fixed capacity FIFO in one contiguous block; oldest first
+    template <typename T, size_t capacity>
+    class RingBuffer {
+        std::array<T, capacity> items{};
+        size_t head = 0;
+        size_t count = 0;
 
-        TBChatMessage(const wchar_t* _message, const uint32_t _channel, const FILETIME _timestamp)
+    public:
+        [[nodiscard]] size_t size() const { return count; }
+        [[nodiscard]] bool empty() const { return count == 0; }
+        [[nodiscard]] bool full() const { return count == capacity; }
+        T& operator[](const size_t i) { return items[(head + i) % capacity]; }
+        const T& operator[](const size_t i) const { return items[(head + i) % capacity]; }
+        T& front() { return (*this)[0]; }
+        T& back() { return (*this)[count - 1]; }
+
+        // Caller makes room first
+        void push_back(const T& item)
+        {
+            ASSERT(!full());
+            items[(head + count++) % capacity] = item;
+        }
+        // Insert before position pos, moving the ones after it up by one. Caller makes room first
+        void insert(const size_t pos, const T& item)
+        {
+            ASSERT(!full() && pos <= count);
+            for (size_t i = count; i > pos; i--) {
+                (*this)[i] = (*this)[i - 1];
+            }
+            (*this)[pos] = item;
+            count++;
+        }
+        void pop_front()
         {
-            msg = _message;
-            timestamp = _timestamp;
-            channel = _channel;
+            ASSERT(!empty());
+            head = (head + 1) % capacity;
+            count--;
+        }
+        void clear()
+        {
+            head = count = 0;
+        }
+    };
+
+    // Every distinct message text is kept once, however many log entries repeat it; entries point at the copy in here
+    struct WStringHash {
+        using is_transparent = void;
+        size_t operator()(const std::wstring_view str) const { return std::hash<std::wstring_view>{}(str); }
+    };
+    std::unordered_map<std::wstring, uint32_t, WStringHash, std::equal_to<>> interned_messages; // message => ref count
+
+    const std::wstring* Intern(const std::wstring_view message)
+    {
+        auto found = interned_messages.find(message);
+        if (found == interned_messages.end()) {
+            found = interned_messages.emplace(message, 0).first;
         }
+        found->second++;
+        return &found->first;
+    }
+
+    // nullptr if the message isn't in either log, in which case it can't be a duplicate
+    const std::wstring* FindInterned(const std::wstring_view message)
+    {
+        const auto found = interned_messages.find(message);
+        return found != interned_messages.end() ? &found->first : nullptr;
+    }
+
+    void Release(const std::wstring* message)
+    {
+        const auto found = interned_messages.find(*message);
+        if (found != interned_messages.end() && --found->second == 0) {
+            interned_messages.erase(found);
+        }
+    }
+
+    uint64_t FileTimeToUInt64(const FILETIME& ft)
+    {
+        return static_cast<uint64_t>(ft.dwHighDateTime) << 32 | ft.dwLowDateTime;
+    }
+
+    struct TBChatMessage {
+        const std::wstring* msg = nullptr; // Interned
+        uint32_t channel = 0;
+        FILETIME timestamp{};
     };
 
     struct TBSentMessage {
-        TBSentMessage* next{};
-        TBSentMessage* prev{};
-        std::wstring msg;
+        const std::wstring* msg = nullptr; // Interned
         uint32_t gw_message_address = 0; // Used to ensure that messages aren't logged twice
-        TBSentMessage(wchar_t* _message, const uint32_t addr = 0)
+    };
+
+    // Identifies a log entry for duplicate checks: timestamp or GW address, plus the interned message
+    using MessageKey = std::pair<uint64_t, const std::wstring*>;
+    struct MessageKeyHash {
+        size_t operator()(const MessageKey& key) const
         {
-            msg = _message;
-            gw_message_address = addr ? addr : (uint32_t)_message;
+            return std::hash<uint64_t>{}(key.first) ^ std::hash<const void*>{}(key.second) * 31;
         }
     };
 
-    TBChatMessage* recv_first = nullptr;
-    TBChatMessage* recv_last = nullptr;
-    TBSentMessage* sent_first = nullptr;
-    TBSentMessage* sent_last = nullptr;
-    TBChatMessage* timestamp_override_message = nullptr;
+    // Sorted by timestamp
+    RingBuffer<TBChatMessage, GW::Chat::CHAT_LOG_LENGTH> recv_log;
+    std::unordered_set<MessageKey, MessageKeyHash> recv_keys;
+    RingBuffer<TBSentMessage, GW::Chat::SENT_LOG_LENGTH> sent_log;
+    std::unordered_set<MessageKey, MessageKeyHash> sent_keys;
+    const TBChatMessage* timestamp_override_message = nullptr;
 
     bool IsValidPtr(void* ptr) {
         return ptr && ((size_t)ptr & 3) == 0;
@@ -108,57 +181,288 @@ namespace {
     }
 
     // Check outgoing log to see if message has already been added
-    bool IsAdded(wchar_t* _message, uint32_t addr)
+    bool IsAdded(const wchar_t* _message, uint32_t addr)
     {
         if (!addr) {
             addr = (uint32_t)_message;
         }
-        const TBSentMessage* sent = sent_last;
-        while (sent) {
-            // NB: GW uses TList in memory which means the only time the address will be nuked is when the log is cleared anyway
-            if (sent->gw_message_address == addr && wcscmp(sent->msg.c_str(), _message) == 0) {
-                return true;
-            }
-            if (sent == sent_first) {
-                break;
-            }
-            sent = sent->prev;
-        }
-        return false;
+        // NB: GW uses TList in memory which means the only time the address will be nuked is when the log is cleared anyway
+        const auto interned = FindInterned(_message);
+        return interned && sent_keys.contains({addr, interned});
     }
 
     // Path to chat log file on disk
-    std::filesystem::path LogPath(const wchar_t* prefix)
+    std::filesystem::path LogPath(const wchar_t* prefix, const wchar_t* extension = L"ini")
     {
         wchar_t fn[128];
-        swprintf(fn, 128, L"%s_%s.ini", prefix, account.c_str());
+        swprintf(fn, 128, L"%s_%s.%s", prefix, account.c_str(), extension);
         Resources::EnsureFolderExists(Resources::GetPath(L"chat logs"));
         return Resources::GetPath(L"chat logs", fn);
     }
 
-    // Remove message from incoming log
-    void Remove(const TBChatMessage* message)
+    // Chat history journal: one file per account, only ever appended to while playing.
+    // journal_magic and journal_version, followed by records of
+    //   uint32_t size (of the rest of the record), RecordType type, then
+    //   Received: uint64_t timestamp (FILETIME), uint32_t channel, message
+    //   Sent:     uint32_t gw message address, message
+    // where message is the encoded message's wchar_ts, without a null terminator.
+    // Records past history_days, and sent records that have dropped out of the sent log, are dropped by Compact().
+    constexpr char journal_magic[4] = {'T', 'B', 'C', 'L'};
+    constexpr uint32_t journal_version = 1;
+    constexpr size_t journal_header_size = sizeof(journal_magic) + sizeof(journal_version);
+    enum class RecordType : uint8_t {
+        Received = 1,
+        Sent = 2
+    };
+    constexpr size_t received_header_size = sizeof(RecordType) + sizeof(uint64_t) + sizeof(uint32_t);
+    constexpr size_t sent_header_size = sizeof(RecordType) + sizeof(uint32_t);
+    // Compacting rewrites the whole file; wait until there's at least this much to reclaim
+    constexpr uint64_t min_compact_bytes = 256 * 1024;
+    // Bounds on the history index. Past max_index_postings the longest posting lists are dropped and their words
+    // checked against the message text instead; past max_index_words new words aren't indexed at all.
+    constexpr size_t max_index_postings = 4 * 1024 * 1024;
+    constexpr size_t max_index_words = 256 * 1024;
+    constexpr uint64_t filetime_ticks_per_day = 24ull * 60 * 60 * 10000000;
+
+    uint32_t history_days = 90;
+    bool loading = false; // Reading the journal back in; don't append what's read to it again
+
+    // Guards everything below; the journal is written from the game thread and searched from workers
+    std::mutex journal_mutex;
+    std::ofstream journal;
+    std::filesystem::path journal_path;
+    uint64_t journal_bytes = 0;
+    uint32_t journal_generation = 0; // Bumped whenever the spans below stop pointing into the file, see ChatLog::Search
+    uint64_t dead_bytes = 0; // Records that Compact() would drop, other than expired history
+
+    struct RecordSpan {
+        uint64_t offset = 0;
+        uint32_t size = 0; // Including its size field
+    };
+    struct HistoryRecord {
+        RecordSpan span;
+        uint64_t timestamp = 0;
+    };
+    // Received records in the journal, in file order
+    std::vector<HistoryRecord> history;
+    // Lower case word => indices into history, ascending
+    std::unordered_map<std::wstring, std::vector<uint32_t>, WStringHash, std::equal_to<>> history_index;
+    // Words whose posting lists were dropped to keep the index within max_index_postings
+    std::unordered_set<std::wstring, WStringHash, std::equal_to<>> common_words;
+    size_t index_postings = 0;
+    bool index_full = false; // Some words were left out for max_index_words
+    // Sent records still in the sent log, oldest first
+    std::deque<RecordSpan> sent_records;
+
+    // Search box in the settings: searched on a worker once typing has paused for search_delay
+    constexpr auto search_delay = std::chrono::milliseconds(300);
+    std::mutex search_mutex;
+    // Guarded by search_mutex
+    std::vector<ChatLog::HistoryMessage> search_results;
+    uint32_t search_generation = 0; // Results of anything but the latest search are dropped
+
+    uint64_t HistoryCutoff()
+    {
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        return FileTimeToUInt64(now) - static_cast<uint64_t>(history_days) * filetime_ticks_per_day;
+    }
+
+    // Calls on_literal for each part of an encoded message that players typed themselves
+    template <typename Fn>
+    void ForEachLiteral(const std::wstring_view message, Fn&& on_literal)
+    {
+        size_t pos = 0;
+        while ((pos = message.find(static_cast<wchar_t>(0x107), pos)) != std::wstring_view::npos) {
+            const auto end = message.find(static_cast<wchar_t>(0x1), pos + 1);
+            on_literal(message.substr(pos + 1, end == std::wstring_view::npos ? std::wstring_view::npos : end - pos - 1));
+            if (end == std::wstring_view::npos) {
+                break;
+            }
+            pos = end + 1;
+        }
+    }
+
+    // Calls on_word for each word in text, lower cased and without diacritics
+    template <typename Fn>
+    void ForEachWord(const std::wstring_view text, Fn&& on_word)
+    {
+        thread_local std::wstring folded;
+        GuiUtils::RemoveDiacritics(text, folded);
+        GuiUtils::ToLowerInPlace(folded);
+        size_t start = 0;
+        for (size_t i = 0; i <= folded.size(); i++) {
+            if (i < folded.size() && iswalnum(folded[i])) {
+                continue;
+            }
+            if (i - start >= 2) {
+                on_word(std::wstring_view(folded).substr(start, i - start));
+            }
+            start = i + 1;
+        }
+    }
+
+    std::wstring LiteralText(const std::wstring_view message)
+    {
+        std::wstring out;
+        ForEachLiteral(message, [&out](const std::wstring_view literal) {
+            if (!out.empty()) {
+                out += L' ';
+            }
+            out += literal;
+        });
+        return out;
+    }
+
+    // Caller holds journal_mutex
+    void IndexHistory(const uint32_t index, const std::wstring_view message)
     {
-        if (message == recv_first) {
-            recv_first = message->next;
+        ForEachLiteral(message, [index](const std::wstring_view literal) {
+            ForEachWord(literal, [index](const std::wstring_view word) {
+                auto found = history_index.find(word);
+                if (found == history_index.end()) {
+                    if (common_words.contains(word)) {
+                        return;
+                    }
+                    if (history_index.size() >= max_index_words) {
+                        index_full = true;
+                        return;
+                    }
+                    found = history_index.emplace(word, std::vector<uint32_t>{}).first;
+                }
+                auto& postings = found->second;
+                if (postings.empty() || postings.back() != index) {
+                    postings.push_back(index);
+                    index_postings++;
+                }
+            });
+        });
+        while (index_postings > max_index_postings) {
+            // The longest lists are the least use for narrowing a search down anyway
+            const auto longest = std::ranges::max_element(history_index, {}, [](const auto& entry) { return entry.second.size(); });
+            index_postings -= longest->second.size();
+            common_words.insert(longest->first);
+            history_index.erase(longest);
         }
-        if (message == recv_last) {
-            recv_last = message->prev;
+    }
+
+    // Caller holds journal_mutex
+    void ClearHistory()
+    {
+        history.clear();
+        history_index.clear();
+        common_words.clear();
+        index_postings = 0;
+        index_full = false;
+        sent_records.clear();
+        journal_bytes = dead_bytes = 0;
+        journal_generation++;
+    }
+
+    template <typename T>
+    void Put(std::string& out, const T& value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    T Get(const char* data)
+    {
+        T value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    std::string MakeRecord(const RecordType type, const std::wstring_view message, const uint64_t timestamp, const uint32_t channel_or_address)
+    {
+        const auto header_size = type == RecordType::Received ? received_header_size : sent_header_size;
+        std::string record;
+        record.reserve(sizeof(uint32_t) + header_size + message.size() * sizeof(wchar_t));
+        Put(record, static_cast<uint32_t>(header_size + message.size() * sizeof(wchar_t)));
+        Put(record, type);
+        if (type == RecordType::Received) {
+            Put(record, timestamp);
         }
-        message->next->prev = message->prev;
-        message->prev->next = message->next;
-        if (recv_first == message) {
-            recv_first = nullptr;
+        Put(record, channel_or_address);
+        record.append(reinterpret_cast<const char*>(message.data()), message.size() * sizeof(wchar_t));
+        return record;
+    }
+
+    // Caller holds journal_mutex
+    RecordSpan AppendRecord(const std::string& record)
+    {
+        const RecordSpan span = {journal_bytes, static_cast<uint32_t>(record.size())};
+        journal.write(record.data(), static_cast<std::streamsize>(record.size()));
+        journal_bytes += record.size();
+        return span;
+    }
+
+    // Caller holds journal_mutex
+    void AddHistory(const RecordSpan span, const uint64_t timestamp, const std::wstring_view message)
+    {
+        history.push_back({span, timestamp});
+        IndexHistory(static_cast<uint32_t>(history.size() - 1), message);
+    }
+
+    // Caller holds journal_mutex
+    void AddSentRecord(const RecordSpan span)
+    {
+        sent_records.push_back(span);
+        if (sent_records.size() > GW::Chat::SENT_LOG_LENGTH) {
+            dead_bytes += sent_records.front().size;
+            sent_records.pop_front();
         }
-        if (recv_last == message) {
-            recv_last = nullptr;
+    }
+
+    // Caller holds journal_mutex
+    void AppendReceived(const TBChatMessage& message)
+    {
+        const auto timestamp = FileTimeToUInt64(message.timestamp);
+        AddHistory(AppendRecord(MakeRecord(RecordType::Received, *message.msg, timestamp, message.channel)), timestamp, *message.msg);
+    }
+
+    // Caller holds journal_mutex
+    void AppendSent(const TBSentMessage& message)
+    {
+        AddSentRecord(AppendRecord(MakeRecord(RecordType::Sent, *message.msg, 0, message.gw_message_address)));
+    }
+
+    void JournalReceived(const TBChatMessage& message)
+    {
+        if (loading) {
+            return;
+        }
+        std::lock_guard lock(journal_mutex);
+        if (journal.is_open()) {
+            AppendReceived(message);
+            journal.flush(); // So a crash doesn't take the session with it
         }
-        recv_count--;
-        delete message;
     }
-    
+
+    void JournalSent(const TBSentMessage& message)
+    {
+        if (loading) {
+            return;
+        }
+        std::lock_guard lock(journal_mutex);
+        if (journal.is_open()) {
+            AppendSent(message);
+            journal.flush();
+        }
+    }
+
+
+    // Remove oldest message from incoming log
+    void RemoveOldest()
+    {
+        const auto& message = recv_log.front();
+        recv_keys.erase({FileTimeToUInt64(message.timestamp), message.msg});
+        Release(message.msg);
+        recv_log.pop_front();
+    }
+
     // Add message to incoming log
-    void Add(wchar_t* _message, const uint32_t _channel, const FILETIME _timestamp)
+    void Add(const wchar_t* _message, const uint32_t _channel, const FILETIME _timestamp)
     {
         if (injecting || !enabled) {
             return;
@@ -166,59 +470,37 @@ namespace {
         if (!(((size_t)_message & 3) == 0 && _message[0])) {
             return; // Empty message
         }
-        const auto new_message = new TBChatMessage(_message, _channel, _timestamp);
-        TBChatMessage* inject = recv_last;
-        if (!recv_first) {
-            // No first element; log is empty.
-            new_message->prev = new_message->next = recv_first = recv_last = new_message;
-            goto trim_log;
+        const auto time = FileTimeToUInt64(_timestamp);
+        if (const auto interned = FindInterned(_message); interned && recv_keys.contains({time, interned})) {
+            return; // Duplicate message
         }
-
-        while (recv_first) {
-            switch (CompareFileTime(&inject->timestamp, &_timestamp)) {
-            case 0: // Equal; check message cmp
-                if (wcscmp(_message, inject->msg.c_str()) == 0) {
-                    // Duplicate message?
-                    return;
-                }
-            case 1: // new_message is earlier; keep going back
-                if (inject == recv_first) {
-                    // Earliest message, insert before
-                    new_message->prev = inject->prev;
-                    new_message->next = inject;
-                    if (inject->prev != inject) {
-                        inject->prev->next = new_message;
-                    }
-                    if (inject->next == inject) {
-                        inject->next = new_message;
-                    }
-                    inject->prev = new_message;
-                    recv_first = new_message;
-                    goto trim_log;
-                }
-                inject = inject->prev;
-                break;
-            case -1: // new_message is later; add here.
-                new_message->next = inject->next;
-                new_message->prev = inject;
-                if (inject->next != inject) {
-                    inject->next->prev = new_message;
-                }
-                inject->next = new_message;
-                if (inject->prev == inject) {
-                    inject->prev = new_message;
+        // Messages nearly always arrive in order; otherwise find where it goes. Equal timestamps keep arrival order.
+        size_t pos = recv_log.size();
+        if (!recv_log.empty() && FileTimeToUInt64(recv_log.back().timestamp) > time) {
+            size_t lo = 0;
+            size_t hi = recv_log.size();
+            while (lo < hi) {
+                const auto mid = lo + (hi - lo) / 2;
+                if (FileTimeToUInt64(recv_log[mid].timestamp) <= time) {
+                    lo = mid + 1;
                 }
-                if (inject == recv_last) {
-                    recv_last = new_message;
+                else {
+                    hi = mid;
                 }
-                goto trim_log;
             }
+            pos = lo;
         }
-    trim_log:
-        recv_count++;
-        while (recv_count > GW::Chat::CHAT_LOG_LENGTH) {
-            Remove(recv_first);
+        if (recv_log.full()) {
+            if (pos == 0) {
+                return; // Older than everything in a full log; it'd be trimmed straight away
+            }
+            RemoveOldest();
+            pos--;
         }
+        const TBChatMessage message = {Intern(_message), _channel, _timestamp};
+        recv_log.insert(pos, message);
+        recv_keys.insert({time, message.msg});
+        JournalReceived(message);
     }
     // Add message to incoming log
     void Add(GW::Chat::ChatMessage* in)
@@ -227,25 +509,13 @@ namespace {
     }
 
 
-    // Remove message from outgoing log
-    void RemoveSent(const TBSentMessage* message)
+    // Remove oldest message from outgoing log
+    void RemoveOldestSent()
     {
-        if (message == sent_first) {
-            sent_first = message->next;
-        }
-        if (message == sent_last) {
-            sent_last = message->prev;
-        }
-        message->next->prev = message->prev;
-        message->prev->next = message->next;
-        if (sent_first == message) {
-            sent_first = nullptr;
-        }
-        if (sent_last == message) {
-            sent_last = nullptr;
-        }
-        sent_count--;
-        delete message;
+        const auto& message = sent_log.front();
+        sent_keys.erase({message.gw_message_address, message.msg});
+        Release(message.msg);
+        sent_log.pop_front();
     }
 
     // Add message to outgoing log
@@ -257,29 +527,13 @@ namespace {
         if (injecting || IsAdded(_message, addr)) {
             return;
         }
-
-        const auto new_message = new TBSentMessage(_message, addr);
-        TBSentMessage* inject = sent_last;
-        if (!sent_first) {
-            // No first element; log is empty.
-            new_message->prev = new_message->next = sent_first = sent_last = new_message;
-            goto trim_log;
-        }
-        // Add after the last element
-        new_message->next = inject->next;
-        new_message->prev = inject;
-        if (inject->next != inject) {
-            inject->next->prev = new_message;
-        }
-        inject->next = new_message;
-        if (inject == sent_last) {
-            sent_last = new_message;
-        }
-    trim_log:
-        sent_count++;
-        while (sent_count > GW::Chat::SENT_LOG_LENGTH) {
-            RemoveSent(sent_first);
+        if (sent_log.full()) {
+            RemoveOldestSent();
         }
+        const TBSentMessage message = {Intern(_message), addr ? addr : (uint32_t)_message};
+        sent_log.push_back(message);
+        sent_keys.insert({message.gw_message_address, message.msg});
+        JournalSent(message);
     }
     
     // Collect current in-game logs and combine them with the tb logs
@@ -314,75 +568,248 @@ namespace {
     }
 
 
-    void Save()
+    // True if what's at pos looks like a record: a known type, with a size that suits it and fits in data
+    bool IsRecordAt(const std::vector<char>& data, const size_t pos)
     {
-        if (!enabled || account.empty()) {
-            return;
+        if (pos + sizeof(uint32_t) + sizeof(RecordType) > data.size()) {
+            return false;
+        }
+        const auto size = Get<uint32_t>(data.data() + pos);
+        const auto type = static_cast<RecordType>(data[pos + sizeof(uint32_t)]);
+        if (type != RecordType::Received && type != RecordType::Sent) {
+            return false;
         }
-        // Received log FIFO
-        auto inifile = new ToolboxIni(false, false, false);
-        std::string msg_buf;
-        char addr_buf[8];
-        const TBChatMessage* recv = recv_first;
-        size_t i = 0;
-        std::string datetime_str;
-        while (recv) {
-            if (GuiUtils::TimeToString(recv->timestamp, datetime_str)) {
-                snprintf(addr_buf, 8, "%03x", i++);
-                ASSERT(GuiUtils::ArrayToIni(recv->msg.data(), &msg_buf));
-                inifile->SetValue(addr_buf, "message", msg_buf.c_str());
-                inifile->SetLongValue(addr_buf, "dwLowDateTime", recv->timestamp.dwLowDateTime);
-                inifile->SetLongValue(addr_buf, "dwHighDateTime", recv->timestamp.dwHighDateTime);
-                inifile->SetLongValue(addr_buf, "channel", recv->channel);
-                inifile->SetValue(addr_buf, "datetime", datetime_str.c_str());
+        const auto header_size = type == RecordType::Received ? received_header_size : sent_header_size;
+        return size >= header_size && (size - header_size) % sizeof(wchar_t) == 0 && pos + sizeof(uint32_t) + size <= data.size();
+    }
+
+    // Where the next intact record starts after a damaged one at pos, or data.size() if there isn't one.
+    // A candidate has to be followed by another record or the end of the file, so message text is unlikely to pass for one.
+    size_t FindNextRecord(const std::vector<char>& data, size_t pos)
+    {
+        for (pos++; pos < data.size(); pos++) {
+            if (!IsRecordAt(data, pos)) {
+                continue;
             }
-            else {
-                Log::Log("Failed to turn timestamp for message %d into string", i);
+            const size_t next = pos + sizeof(uint32_t) + Get<uint32_t>(data.data() + pos);
+            if (next == data.size() || IsRecordAt(data, next)) {
+                return pos;
             }
+        }
+        return data.size();
+    }
 
-            if (recv == recv_last) {
-                break;
+    // Read the journal into the history index and, with fill_logs, the chat logs. A damaged record is skipped up to
+    // the next intact one; a torn one at the end is cut off.
+    // Returns false if there's no journal, or it isn't one. Caller holds journal_mutex.
+    bool ReadJournal(const bool fill_logs = true)
+    {
+        std::ifstream in(journal_path, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        const std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        if (data.size() < journal_header_size
+            || memcmp(data.data(), journal_magic, sizeof(journal_magic)) != 0
+            || Get<uint32_t>(data.data() + sizeof(journal_magic)) != journal_version) {
+            return false;
+        }
+        const auto cutoff = HistoryCutoff();
+        std::wstring message;
+        size_t pos = journal_header_size;
+        loading = true;
+        while (pos + sizeof(uint32_t) <= data.size()) {
+            const auto size = Get<uint32_t>(data.data() + pos);
+            const auto body = data.data() + pos + sizeof(uint32_t);
+            if (!size || pos + sizeof(uint32_t) + size > data.size()) {
+                const auto next = FindNextRecord(data, pos);
+                if (next == data.size()) {
+                    break; // Torn write
+                }
+                Log::Log("Chat journal damaged at offset %zu, skipped %zu bytes", pos, next - pos);
+                dead_bytes += next - pos;
+                pos = next;
+                continue;
+            }
+            const RecordSpan span = {pos, static_cast<uint32_t>(sizeof(uint32_t) + size)};
+            const auto type = static_cast<RecordType>(body[0]);
+            const auto header_size = type == RecordType::Received ? received_header_size : sent_header_size;
+            if (size >= header_size && (size - header_size) % sizeof(wchar_t) == 0) {
+                message.resize((size - header_size) / sizeof(wchar_t));
+                memcpy(message.data(), body + header_size, size - header_size);
+                if (type == RecordType::Received) {
+                    const auto timestamp = Get<uint64_t>(body + sizeof(RecordType));
+                    if (timestamp >= cutoff) {
+                        AddHistory(span, timestamp, message);
+                        if (fill_logs) {
+                            const FILETIME ft = {static_cast<DWORD>(timestamp), static_cast<DWORD>(timestamp >> 32)};
+                            Add(message.c_str(), Get<uint32_t>(body + sizeof(RecordType) + sizeof(uint64_t)), ft);
+                        }
+                    }
+                    else {
+                        dead_bytes += span.size;
+                    }
+                }
+                else if (type == RecordType::Sent) {
+                    AddSentRecord(span);
+                    if (fill_logs) {
+                        AddSent(message.data(), Get<uint32_t>(body + sizeof(RecordType)));
+                    }
+                }
+                else {
+                    dead_bytes += span.size;
+                }
+            }
+            else {
+                dead_bytes += span.size;
             }
-            recv = recv->next;
-        }
-        const auto res = inifile->SaveFile(LogPath(L"recv").c_str());
-        ASSERT(res == SI_OK);
-        delete inifile;
-
-        // Sent log FIFO
-        inifile = new ToolboxIni(false, false, false);
-        const TBSentMessage* sent = sent_first;
-        i = 0;
-        while (sent) {
-            snprintf(addr_buf, 8, "%03x", i++);
-            ASSERT(GuiUtils::ArrayToIni(sent->msg.c_str(), &msg_buf));
-            inifile->SetValue(addr_buf, "message", msg_buf.c_str());
-            inifile->SetLongValue(addr_buf, "addr", sent->gw_message_address);
-            if (sent == sent_last) {
+            pos = span.offset + span.size;
+        }
+        loading = false;
+        journal_bytes = pos;
+        if (pos < data.size()) {
+            std::error_code ec;
+            std::filesystem::resize_file(journal_path, pos, ec);
+        }
+        return true;
+    }
+
+    // Caller holds journal_mutex
+    void WriteJournalHeader()
+    {
+        journal.write(journal_magic, sizeof(journal_magic));
+        journal.write(reinterpret_cast<const char*>(&journal_version), sizeof(journal_version));
+        journal_bytes = journal_header_size;
+    }
+
+    // Start a new journal from what's in the chat logs now. Caller holds journal_mutex.
+    void CreateJournal()
+    {
+        journal.open(journal_path, std::ios::binary | std::ios::trunc);
+        if (!journal.is_open()) {
+            return;
+        }
+        WriteJournalHeader();
+        for (size_t i = 0; i < recv_log.size(); i++) {
+            AppendReceived(recv_log[i]);
+        }
+        for (size_t i = 0; i < sent_log.size(); i++) {
+            AppendSent(sent_log[i]);
+        }
+        journal.flush();
+    }
+
+    // Caller holds journal_mutex
+    bool CompactionDue()
+    {
+        const auto cutoff = HistoryCutoff();
+        uint64_t reclaimable = dead_bytes;
+        for (const auto& record : history) {
+            if (record.timestamp >= cutoff) {
                 break;
             }
-            sent = sent->next;
+            reclaimable += record.span.size;
         }
-        ASSERT(inifile->SaveFile(LogPath(L"sent").c_str()) == SI_OK);
-        delete inifile;
+        return reclaimable >= min_compact_bytes && reclaimable * 4 > journal_bytes;
     }
-    void Reset()
+
+    // Rewrite the journal without expired history or sent records that have dropped out of the sent log. Caller holds journal_mutex.
+    void Compact()
     {
-        while (recv_count && recv_first) {
-            Remove(recv_first);
+        journal.close();
+        std::ifstream in(journal_path, std::ios::binary);
+        const std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+
+        const auto cutoff = HistoryCutoff();
+        std::vector<std::pair<RecordSpan, bool>> keep; // Span, is history
+        for (const auto& record : history) {
+            if (record.timestamp >= cutoff) {
+                keep.emplace_back(record.span, true);
+            }
         }
-        while (sent_count && sent_first) {
-            RemoveSent(sent_first);
+        for (const auto& span : sent_records) {
+            keep.emplace_back(span, false);
         }
+        std::ranges::sort(keep, {}, [](const auto& k) { return k.first.offset; });
+
+        auto tmp_path = journal_path;
+        tmp_path += L".tmp";
+        journal.open(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!journal.is_open()) {
+            journal.open(journal_path, std::ios::binary | std::ios::app);
+            return;
+        }
+        ClearHistory();
+        WriteJournalHeader();
+        std::wstring message;
+        for (const auto& [span, is_history] : keep) {
+            if (span.offset + span.size > data.size()) {
+                continue;
+            }
+            const std::string record(data.data() + span.offset, span.size);
+            const auto new_span = AppendRecord(record);
+            if (!is_history) {
+                sent_records.push_back(new_span);
+                continue;
+            }
+            const auto body = record.data() + sizeof(uint32_t);
+            message.resize((span.size - sizeof(uint32_t) - received_header_size) / sizeof(wchar_t));
+            memcpy(message.data(), body + received_header_size, message.size() * sizeof(wchar_t));
+            AddHistory(new_span, Get<uint64_t>(body + sizeof(RecordType)), message);
+        }
+        journal.close();
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, journal_path, ec);
+        if (ec) {
+            // Spans now point into the file we couldn't swap in; go back to the old one as it is.
+            // The chat logs already hold its messages, and InjectSent may have changed the sent addresses since,
+            // so only the spans are read back; adding the sent messages again would duplicate them.
+            Log::Log("Failed to replace chat journal: %s", ec.message().c_str());
+            std::filesystem::remove(tmp_path, ec);
+            ClearHistory();
+            ReadJournal(false);
+        }
+        journal.open(journal_path, std::ios::binary | std::ios::app);
     }
 
-    // Load chat log from file via account email address
-    void Load(const std::wstring& _account)
+    void CloseJournal()
     {
-        Reset();
+        std::lock_guard lock(journal_mutex);
+        journal.close();
+        ClearHistory();
+    }
+
+    // Flush the journal, compacting it if enough of it has expired
+    void Save()
+    {
+        if (!enabled || account.empty()) {
+            return;
+        }
+        std::lock_guard lock(journal_mutex);
+        if (!journal.is_open()) {
+            return;
+        }
+        journal.flush();
+        if (CompactionDue()) {
+            Compact();
+        }
+    }
+    void Reset()
+    {
+        recv_log.clear();
+        recv_keys.clear();
+        sent_log.clear();
+        sent_keys.clear();
+        interned_messages.clear();
+        timestamp_override_message = nullptr;
+    }
 
+    // Chat logs from before the journal, one ini file each for received and sent messages
+    void LoadIni()
+    {
         // Recv log FIFO
-        account = _account;
         ToolboxIni inifile;
         ASSERT(inifile.LoadIfExists(LogPath(L"recv")) == SI_OK);
 
@@ -423,6 +850,35 @@ namespace {
             AddSent(buf.data(), addr);
         }
     }
+
+    // Load chat log from file via account email address
+    void Load(const std::wstring& _account)
+    {
+        Reset();
+        CloseJournal();
+        account = _account;
+
+        std::lock_guard lock(journal_mutex);
+        journal_path = LogPath(L"chat", L"log");
+        if (!ReadJournal()) {
+            if (std::filesystem::exists(journal_path)) {
+                // Not ours, or from a newer version; keep it out of the way rather than overwrite it
+                auto bad_path = journal_path;
+                bad_path += L".bad";
+                std::error_code ec;
+                std::filesystem::rename(journal_path, bad_path, ec);
+            }
+            loading = true;
+            LoadIni();
+            loading = false;
+            CreateJournal();
+            return;
+        }
+        journal.open(journal_path, std::ios::binary | std::ios::app);
+        if (CompactionDue()) {
+            Compact();
+        }
+    }
     void InjectSent()
     {
         injecting = true;
@@ -433,20 +889,18 @@ namespace {
             return;
         }
         // Fill chat log
-        TBSentMessage* sent = sent_first;
-        while (sent) {
-            if (sent->msg.data() && sent->msg.length()) {
-                // Only add to log if the message has content
-                AddToSentLog_Func(sent->msg.data());
+        for (size_t i = 0; i < sent_log.size(); i++) {
+            auto& sent = sent_log[i];
+            if (sent.msg->length()) {
+                // Only add to log if the message has content; GW takes a mutable buffer but only reads it
+                AddToSentLog_Func(const_cast<wchar_t*>(sent.msg->data()));
                 if (!out_log) {
                     out_log = GetSentLog();
                 }
-                sent->gw_message_address = (uint32_t)out_log->prev->message;
-            }
-            if (sent == sent_last) {
-                break;
+                sent_keys.erase({sent.gw_message_address, sent.msg});
+                sent.gw_message_address = (uint32_t)out_log->prev->message;
+                sent_keys.insert({sent.gw_message_address, sent.msg});
             }
-            sent = sent->next;
         }
         injecting = false;
     }
@@ -457,8 +911,7 @@ namespace {
             injecting = false;
             return;
         }
-        TBChatMessage* recv = recv_first;
-        if (recv) {
+        if (!recv_log.empty()) {
             ClearChatLog_Func();
             const GW::Chat::ChatBuffer* log = GW::Chat::GetChatLog();
             ASSERT(!log);
@@ -469,18 +922,15 @@ namespace {
             size_t log_pos = log ? log->next : 0;
             injecting = true;
 
-            while (recv) {
-                timestamp_override_message = recv;
-                ASSERT(GW::Chat::AddToChatLog(timestamp_override_message->msg.data(), timestamp_override_message->channel));
+            // Nothing is added to recv_log while injecting, so entries stay put
+            for (size_t i = 0; i < recv_log.size(); i++) {
+                timestamp_override_message = &recv_log[i];
+                ASSERT(GW::Chat::AddToChatLog(const_cast<wchar_t*>(timestamp_override_message->msg->data()), timestamp_override_message->channel));
                 if (!log) {
                     log = GW::Chat::GetChatLog();
                 }
                 ASSERT(log && !timestamp_override_message && log_pos != log->next);
                 log_pos = log->next;
-                if (recv == recv_last) {
-                    break;
-                }
-                recv = recv->next;
             }
         }
         InjectSent();
@@ -564,6 +1014,7 @@ void ChatLog::SaveSettings(ToolboxIni* ini)
     ToolboxModule::SaveSettings(ini);
     Save();
     SAVE_BOOL(enabled);
+    SAVE_UINT(history_days);
 }
 
 void ChatLog::LoadSettings(ToolboxIni* ini)
@@ -571,11 +1022,100 @@ void ChatLog::LoadSettings(ToolboxIni* ini)
     ToolboxModule::LoadSettings(ini);
     Save();
     LOAD_BOOL(enabled);
+    LOAD_UINT(history_days);
+    history_days = std::max(history_days, 1u);
     GW::GameThread::Enqueue(Init);
 }
 
 
 
+std::vector<ChatLog::HistoryMessage> ChatLog::Search(const std::wstring_view query, const size_t max_results)
+{
+    std::vector<HistoryMessage> results;
+    // The game thread takes journal_mutex for every chat line, so it's only held to pick the records to read.
+    // If the journal was compacted or replaced while reading them, the spans were stale; try again.
+    for (int attempt = 0; attempt < 3; attempt++) {
+        std::vector<RecordSpan> spans;
+        std::vector<std::wstring> unindexed; // Words left out of the index, checked against the message text instead
+        std::filesystem::path path;
+        uint32_t generation;
+        {
+            std::lock_guard lock(journal_mutex);
+            std::vector<const std::vector<uint32_t>*> postings;
+            bool missing = false;
+            ForEachWord(query, [&](const std::wstring_view word) {
+                if (const auto found = history_index.find(word); found != history_index.end()) {
+                    postings.push_back(&found->second);
+                }
+                else if (index_full || common_words.contains(word)) {
+                    unindexed.emplace_back(word);
+                }
+                else {
+                    missing = true;
+                }
+            });
+            if (missing || postings.empty() || !journal.is_open()) {
+                return results;
+            }
+            // Walk the shortest list newest first, keeping entries every other word's list has too.
+            // If some words aren't indexed, not every match is a result; look a bit further for those.
+            std::ranges::sort(postings, {}, [](const auto* list) { return list->size(); });
+            const auto max_matches = unindexed.empty() ? max_results : max_results * 20;
+            for (auto it = postings[0]->rbegin(); it != postings[0]->rend() && spans.size() < max_matches; ++it) {
+                const auto in_all = std::ranges::all_of(postings | std::views::drop(1), [it](const auto* list) {
+                    return std::ranges::binary_search(*list, *it);
+                });
+                if (in_all) {
+                    spans.push_back(history[*it].span);
+                }
+            }
+            path = journal_path;
+            generation = journal_generation;
+        }
+
+        results.clear();
+        std::ifstream in(path, std::ios::binary);
+        std::string record;
+        std::unordered_set<std::wstring, WStringHash, std::equal_to<>> words;
+        for (const auto& span : spans) {
+            if (results.size() >= max_results) {
+                break;
+            }
+            record.resize(span.size);
+            in.seekg(static_cast<std::streamoff>(span.offset));
+            if (!in.read(record.data(), span.size) || span.size < sizeof(uint32_t) + received_header_size) {
+                in.clear();
+                continue;
+            }
+            const auto body = record.data() + sizeof(uint32_t);
+            std::wstring message((span.size - sizeof(uint32_t) - received_header_size) / sizeof(wchar_t), L'\0');
+            memcpy(message.data(), body + received_header_size, message.size() * sizeof(wchar_t));
+            if (!unindexed.empty()) {
+                words.clear();
+                ForEachWord(LiteralText(message), [&words](const std::wstring_view word) {
+                    words.emplace(word);
+                });
+                if (!std::ranges::all_of(unindexed, [&words](const std::wstring& word) { return words.contains(word); })) {
+                    continue;
+                }
+            }
+            auto& result = results.emplace_back();
+            const auto timestamp = Get<uint64_t>(body + sizeof(RecordType));
+            result.timestamp = {static_cast<DWORD>(timestamp), static_cast<DWORD>(timestamp >> 32)};
+            result.channel = Get<uint32_t>(body + sizeof(RecordType) + sizeof(uint64_t));
+            result.message = std::move(message);
+        }
+        in.close();
+
+        std::lock_guard lock(journal_mutex);
+        if (generation == journal_generation) {
+            return results;
+        }
+    }
+    results.clear();
+    return results;
+}
+
 void ChatLog::SetEnabled(const bool _enabled)
 {
     if (enabled == _enabled) {
@@ -636,10 +1176,52 @@ void ChatLog::RegisterSettingsContent()
             }
             ImGui::Checkbox("Enable GWToolbox chat log", &enabled);
             ImGui::ShowHelp(Description());
+            if (!enabled) {
+                return;
+            }
+            ImGui::Indent();
+            auto days = static_cast<int>(history_days);
+            if (ImGui::InputInt("Keep chat history for (days)", &days)) {
+                history_days = static_cast<uint32_t>(std::max(days, 1));
+            }
+            static char search_buf[128] = "";
+            static std::chrono::steady_clock::time_point search_due;
+            static bool search_pending = false;
+            if (ImGui::InputText("Search chat history", search_buf, sizeof(search_buf))) {
+                search_due = std::chrono::steady_clock::now() + search_delay;
+                search_pending = true;
+            }
+            ImGui::ShowHelp("Finds messages players typed that contain all of the words you enter");
+            if (search_pending && std::chrono::steady_clock::now() >= search_due) {
+                // Reads from disk; keep it off the render thread
+                search_pending = false;
+                uint32_t generation;
+                {
+                    std::lock_guard lock(search_mutex);
+                    generation = ++search_generation;
+                }
+                Resources::EnqueueWorkerTask([query = GuiUtils::StringToWString(search_buf), generation] {
+                    auto results = Search(query);
+                    std::lock_guard lock(search_mutex);
+                    if (generation == search_generation) {
+                        search_results = std::move(results);
+                    }
+                }, Resources::WorkerPriority::High);
+            }
+            std::string datetime_str;
+            std::lock_guard lock(search_mutex);
+            for (const auto& result : search_results) {
+                GuiUtils::TimeToString(result.timestamp, datetime_str);
+                ImGui::TextDisabled("%s", datetime_str.c_str());
+                ImGui::SameLine();
+                ImGui::TextWrapped("%s", GuiUtils::WStringToString(LiteralText(result.message)).c_str());
+            }
+            ImGui::Unindent();
         },
         0.8f);
 }
 ChatLog::~ChatLog() {
     Reset();
+    CloseJournal();
 }
 
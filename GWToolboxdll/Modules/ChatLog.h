@@ -30,4 +30,11 @@ public:
     void SaveSettings(ToolboxIni* ini) override;
     void SetEnabled(bool _enabled);
 
+    struct HistoryMessage {
+        FILETIME timestamp{};
+        uint32_t channel = 0;
+        std::wstring message; // Encoded, as GW logged it
+    };
+    // Received messages in this account's chat history that contain every word in query, newest first
+    static std::vector<HistoryMessage> Search(std::wstring_view query, size_t max_results = 100);
 };
@@ -1,10 +1,14 @@
 #include "stdafx.h"
 
+#include <atomic>
+
 #include <GWCA/Utilities/Scanner.h>
 #include <GWCA/Managers/UIMgr.h>
 #include <GWCA/Managers/ItemMgr.h>
 
 #include <Logger.h>
+#include <Modules/TextureResidency.h>
+#include <Utils/TextureAtlas.h>
 #include "GwDatTextureModule.h"
 
 #include "Resources.h"
@@ -97,23 +101,48 @@ namespace {
     }
 
 
-    // OpenImage converts any GW format to ARGB. It is possible to skip conversion if gw format is compatible with D3FMT.
-    uint32_t OpenImage(uint32_t file_id, gw_image_bits* dst_bits, Vec2i& dims, int& levels, GR_FORMAT& format)
+    struct GwImg {
+        uint32_t m_file_id = 0;
+        Vec2i m_dims;
+        IDirect3DTexture9* m_tex = nullptr;
+    };
+
+    // A dat image on its way to becoming a texture
+    struct StagedImage {
+        GwImg* img = nullptr;
+        gw_image_bits bits = nullptr; // As DecodeImage_func left it, in GW's own format; freed on the render thread
+        GR_FORMAT format = GR_FORMAT_A8R8G8B8;
+        std::vector<uint32_t> pixels; // A8R8G8B8, m_dims.x * m_dims.y
+    };
+    struct DecodeBatch {
+        std::vector<StagedImage> images;
+        std::atomic<size_t> chunks_left = 0;
+    };
+
+    // Images requested since the last batch went out. LoadTextureFromFileId can be called off the render thread.
+    std::mutex pending_mutex;
+    std::vector<GwImg*> pending_images;
+    bool batch_scheduled = false;
+    // Images per worker task; small enough to spread a skill grid over the workers
+    constexpr size_t images_per_chunk = 16;
+
+    // Read the file and unpack it into GW's format, still compressed/palettised.
+    // Uses GW's dat reader, so this stays on the render thread like it always has.
+    bool ReadImage(uint32_t file_id, gw_image_bits& bits, Vec2i& dims, GR_FORMAT& format)
     {
         int size = 0;
         uint8_t* pallete = nullptr;
-        gw_image_bits bits = nullptr;
 
         wchar_t fileHash[4] = { 0 };
         FileIdToFileHash(file_id, fileHash);
 
         auto rec = FileHashToRecObj_func(fileHash, 1, 0);
-        if (!rec) return 0;
+        if (!rec) return false;
 
         const auto bytes = GetRecObjectBytes_func(rec, &size);
         if (!bytes) {
             CloseRecObj_func(rec);
-            return 0;
+            return false;
         }
         int image_size = size;
         auto image_bytes = bytes;
@@ -123,89 +152,313 @@ namespace {
             if (!found) {
                 UnkRecObjBytes_func(rec, bytes);
                 CloseRecObj_func(rec);
-                return 0;
+                return false;
             }
             image_bytes = (uint8_t*)found;
             image_size = *(int*)(found - 4);
         }
 
-        uint32_t result = DecodeImage_func(image_size, image_bytes, &bits, pallete, &format, &dims, &levels);
-        if (rec) {
-            UnkRecObjBytes_func(rec, bytes);
-            if (levels > 13)                return 0;
+        int levels = 0;
+        const uint32_t result = DecodeImage_func(image_size, image_bytes, &bits, pallete, &format, &dims, &levels);
+        UnkRecObjBytes_func(rec, bytes);
+        CloseRecObj_func(rec);
 
-            CloseRecObj_func(rec);
+        if (!result || format >= GR_FORMATS || levels > 13 || !bits || dims.x <= 0 || dims.y <= 0) {
+            if (bits) {
+                FreeImage_func(bits);
+                bits = nullptr;
+            }
+            return false;
         }
+        return true;
+    }
 
-        if (format >= GR_FORMATS || !result) return 0;
+    // DXT1/3/5 (BC1-3) decompression into A8R8G8B8. Our own rather than GW's Depalletize, so it can run on workers.
+    uint32_t Expand565(const uint16_t c)
+    {
+        const uint32_t r = (c >> 11) & 0x1f;
+        const uint32_t g = (c >> 5) & 0x3f;
+        const uint32_t b = c & 0x1f;
+        return 0xff000000 | ((r << 3 | r >> 2) << 16) | ((g << 2 | g >> 4) << 8) | (b << 3 | b >> 2);
+    }
 
-        levels = 1;
-        
-        *dst_bits = AllocateImage_func(GR_FORMAT_A8R8G8B8, &dims, levels, 0);
-        Depalletize_func((gw_image_bits)dst_bits, nullptr, GR_FORMAT_A8R8G8B8, nullptr, bits, pallete, format, nullptr, &dims, levels, 0, 0);
+    // (a * wa + b * wb) / (wa + wb) for each colour channel; alpha is opaque
+    uint32_t Mix(const uint32_t a, const uint32_t b, const uint32_t wa, const uint32_t wb)
+    {
+        uint32_t out = 0xff000000;
+        for (uint32_t shift = 0; shift < 24; shift += 8) {
+            const uint32_t channel = (((a >> shift) & 0xff) * wa + ((b >> shift) & 0xff) * wb) / (wa + wb);
+            out |= channel << shift;
+        }
+        return out;
+    }
 
-        FreeImage_func(bits);
+    void DecodeColorBlock(const uint8_t* block, const bool dxt1, uint32_t out[16])
+    {
+        const uint16_t c0 = static_cast<uint16_t>(block[0] | block[1] << 8);
+        const uint16_t c1 = static_cast<uint16_t>(block[2] | block[3] << 8);
+        uint32_t colors[4];
+        colors[0] = Expand565(c0);
+        colors[1] = Expand565(c1);
+        if (c0 > c1 || !dxt1) {
+            colors[2] = Mix(colors[0], colors[1], 2, 1);
+            colors[3] = Mix(colors[0], colors[1], 1, 2);
+        }
+        else {
+            colors[2] = Mix(colors[0], colors[1], 1, 1);
+            colors[3] = 0; // 1 bit alpha; transparent black
+        }
+        const uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | static_cast<uint32_t>(block[7]) << 24;
+        for (size_t i = 0; i < 16; i++) {
+            out[i] = colors[(indices >> (i * 2)) & 3];
+        }
+    }
 
-        // todo: free bytes;
-        return result;
+    // DXT3: 4 bits of alpha per pixel
+    void DecodeExplicitAlpha(const uint8_t* block, uint32_t out[16])
+    {
+        for (size_t i = 0; i < 16; i++) {
+            const uint32_t alpha = (block[i / 2] >> ((i & 1) * 4)) & 0xf;
+            out[i] = (out[i] & 0x00ffffff) | (alpha * 17) << 24;
+        }
     }
 
-    IDirect3DTexture9* CreateTexture(IDirect3DDevice9* device, uint32_t file_id, Vec2i &dims)
+    // DXT5: 3 bit indices into 8 alpha values interpolated between two endpoints
+    void DecodeInterpolatedAlpha(const uint8_t* block, uint32_t out[16])
     {
-        if (!device || !file_id) {
-            return nullptr;
+        uint32_t alphas[8];
+        alphas[0] = block[0];
+        alphas[1] = block[1];
+        if (alphas[0] > alphas[1]) {
+            for (uint32_t i = 1; i < 7; i++) {
+                alphas[i + 1] = ((7 - i) * alphas[0] + i * alphas[1]) / 7;
+            }
         }
-        
-        gw_image_bits bits = nullptr;
-        int levels;
-        GR_FORMAT format;
-        auto ret = OpenImage(file_id, &bits, dims, levels, format);
-        if (!ret || !bits || !dims.x || !dims.y) {
-            if (bits) {
-                FreeImage_func(bits);
+        else {
+            for (uint32_t i = 1; i < 5; i++) {
+                alphas[i + 1] = ((5 - i) * alphas[0] + i * alphas[1]) / 5;
             }
-            return nullptr;
+            alphas[6] = 0;
+            alphas[7] = 255;
         }
+        uint64_t indices = 0;
+        for (size_t i = 0; i < 6; i++) {
+            indices |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+        }
+        for (size_t i = 0; i < 16; i++) {
+            out[i] = (out[i] & 0x00ffffff) | alphas[(indices >> (i * 3)) & 7] << 24;
+        }
+    }
 
+    // DXT2 and DXT4 are the premultiplied alpha variants of 3 and 5; those are left to GW's converter.
+    bool IsDxt(const GR_FORMAT format)
+    {
+        return format == GR_FORMAT_DXT1 || format == GR_FORMAT_DXT3 || format == GR_FORMAT_DXT5;
+    }
+
+    // DecodeDxt assumes the bits DecodeImage_func hands back are the raw level 0 blocks. That's checked against
+    // GW's converter on the first image of each format, and the format only goes to the workers if they agree.
+    enum class DxtCheck : uint8_t { Unchecked, Matches, Differs };
+    std::array<DxtCheck, GR_FORMATS> dxt_checks{}; // Render thread only
+    // Smaller images can agree by chance, e.g. a single colour
+    constexpr int dxt_check_min_size = 16;
+
+    bool DecodesOnWorker(const GR_FORMAT format)
+    {
+        return IsDxt(format) && dxt_checks[format] == DxtCheck::Matches;
+    }
+
+    // Decode level 0 of a DXT1/3/5 image into width * height A8R8G8B8 pixels
+    void DecodeDxt(const uint8_t* src, const GR_FORMAT format, const int width, const int height, uint32_t* dst)
+    {
+        const size_t block_size = format == GR_FORMAT_DXT1 ? 8 : 16;
+        uint32_t block[16];
+        for (int by = 0; by < height; by += 4) {
+            for (int bx = 0; bx < width; bx += 4, src += block_size) {
+                switch (format) {
+                    case GR_FORMAT_DXT1:
+                        DecodeColorBlock(src, true, block);
+                        break;
+                    case GR_FORMAT_DXT3:
+                        DecodeColorBlock(src + 8, false, block);
+                        DecodeExplicitAlpha(src, block);
+                        break;
+                    default:
+                        DecodeColorBlock(src + 8, false, block);
+                        DecodeInterpolatedAlpha(src, block);
+                        break;
+                }
+                // Blocks on the right/bottom edge may hang over the image
+                const int w = std::min(4, width - bx);
+                const int h = std::min(4, height - by);
+                for (int y = 0; y < h; y++) {
+                    memcpy(dst + static_cast<size_t>(by + y) * width + bx, block + y * 4, w * sizeof(uint32_t));
+                }
+            }
+        }
+    }
+
+    // Anything not decoded on the workers goes through GW's converter, on the render thread
+    bool Depalletize(StagedImage& staged)
+    {
+        Vec2i dims = staged.img->m_dims;
+        gw_image_bits dst_bits = AllocateImage_func(GR_FORMAT_A8R8G8B8, &dims, 1, 0);
+        if (!dst_bits) {
+            return false;
+        }
+        Depalletize_func((gw_image_bits)&dst_bits, nullptr, GR_FORMAT_A8R8G8B8, nullptr, staged.bits, nullptr, staged.format, nullptr, &dims, 1, 0, 0);
+        staged.pixels.resize(static_cast<size_t>(dims.x) * dims.y);
+        memcpy(staged.pixels.data(), dst_bits, staged.pixels.size() * sizeof(uint32_t));
+        FreeImage_func(dst_bits);
+        return true;
+    }
+
+    // Interpolated colours may round differently from GW's decoder; a wrong layout is off by far more than this
+    bool SimilarPixel(const uint32_t a, const uint32_t b)
+    {
+        const auto channel_diff = [a, b](const uint32_t shift) {
+            return std::abs(static_cast<int>((a >> shift) & 0xff) - static_cast<int>((b >> shift) & 0xff));
+        };
+        if (channel_diff(24) > 8) {
+            return false;
+        }
+        if ((a >> 24) == 0) {
+            return true; // Colour of a transparent pixel doesn't matter
+        }
+        return channel_diff(16) <= 12 && channel_diff(8) <= 12 && channel_diff(0) <= 12;
+    }
+
+    // Convert with GW's converter and, the first time a DXT format comes by, check DecodeDxt against it
+    bool DepalletizeAndCheck(StagedImage& staged)
+    {
+        if (!Depalletize(staged)) {
+            return false;
+        }
+        const auto& dims = staged.img->m_dims;
+        if (!IsDxt(staged.format) || dxt_checks[staged.format] != DxtCheck::Unchecked || dims.x < dxt_check_min_size || dims.y < dxt_check_min_size) {
+            return true;
+        }
+        std::vector<uint32_t> decoded(staged.pixels.size());
+        DecodeDxt(staged.bits, staged.format, dims.x, dims.y, decoded.data());
+        const bool matches = std::ranges::equal(decoded, staged.pixels, SimilarPixel);
+        dxt_checks[staged.format] = matches ? DxtCheck::Matches : DxtCheck::Differs;
+        if (!matches) {
+            Log::Warning("GwDatTextureModule: DXT format 0x%x doesn't decode like GW does; using GW's converter for it", static_cast<uint32_t>(staged.format));
+        }
+        return true;
+    }
+
+    IDirect3DTexture9* CreateTexture(IDirect3DDevice9* device, const std::vector<uint32_t>& pixels, const Vec2i& dims)
+    {
         // Create a texture: http://msdn.microsoft.com/en-us/library/windows/desktop/bb174363(v=vs.85).aspx
         IDirect3DTexture9* tex = nullptr;
-        if (device->CreateTexture(dims.x, dims.y, levels, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &tex, 0) != D3D_OK) {
+        if (device->CreateTexture(dims.x, dims.y, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &tex, 0) != D3D_OK) {
             return nullptr;
         }
 
         // Lock the texture for writing: http://msdn.microsoft.com/en-us/library/windows/desktop/bb205913(v=vs.85).aspx
         D3DLOCKED_RECT rect;
-        if (tex->LockRect(0, &rect, 0, D3DLOCK_DISCARD) != D3D_OK) {
+        if (tex->LockRect(0, &rect, 0, 0) != D3D_OK) {
+            tex->Release();
             return nullptr;
         }
-
-        unsigned int* srcdata = (unsigned int*)bits;
         for (int y = 0; y < dims.y; y++) {
-            uint8_t* destAddr = ((uint8_t*)rect.pBits + y * rect.Pitch);
-            memcpy(destAddr, srcdata, dims.x * 4);
-            srcdata += dims.x;
-            /* for (int x = 0; x < dims.x; ++x) {
-                uint8_t* destAddr = ((uint8_t*)rect.pBits + y * rect.Pitch + 4 * x);
-
-                // unsigned int data = 0xFF000000 | (*srcdata >> 24 & 0xFF) | (*srcdata >> 16 & 0xFF00) | (*srcdata >> 8 & 0xFF0000);
-                // memcpy(destAddr, &data, 4);
-                memcpy(destAddr, srcdata, 4);
-                srcdata++;
-            }*/
+            memcpy((uint8_t*)rect.pBits + y * rect.Pitch, pixels.data() + static_cast<size_t>(y) * dims.x, dims.x * 4);
         }
-        
-        FreeImage_func(bits);
 
         // Unlock the texture so it can be used.
         tex->UnlockRect(0);
         return tex;
     }
 
-    struct GwImg {
-        uint32_t m_file_id = 0;
-        Vec2i m_dims;
-        IDirect3DTexture9* m_tex = nullptr;
-    };
+    // Render thread: every image of the batch becomes a texture in the same frame
+    void UploadBatch(IDirect3DDevice9* device, DecodeBatch& batch)
+    {
+        for (auto& staged : batch.images) {
+            if (staged.bits) {
+                FreeImage_func(staged.bits);
+                staged.bits = nullptr;
+            }
+            if (staged.pixels.empty()) {
+                continue;
+            }
+            const auto tex = CreateTexture(device, staged.pixels, staged.img->m_dims);
+            if (!tex) {
+                continue; // Leave the slot as it is, which may be TextureResidency's placeholder
+            }
+            staged.img->m_tex = tex;
+            // Skill and item icons; anything bigger is turned away by the atlas
+            TextureAtlas::Add(device, tex);
+        }
+    }
+
+    // Render thread: read everything requested since the last batch, then decompress on the workers
+    void DecodePending(IDirect3DDevice9* device)
+    {
+        std::vector<GwImg*> images;
+        {
+            std::lock_guard lock(pending_mutex);
+            images.swap(pending_images);
+            batch_scheduled = false;
+        }
+        const auto batch = std::make_shared<DecodeBatch>();
+        batch->images.reserve(images.size());
+        for (const auto img : images) {
+            StagedImage staged{img};
+            if (!ReadImage(img->m_file_id, staged.bits, img->m_dims, staged.format)) {
+                continue;
+            }
+            if (!DecodesOnWorker(staged.format) && !DepalletizeAndCheck(staged)) {
+                FreeImage_func(staged.bits);
+                continue;
+            }
+            batch->images.push_back(std::move(staged));
+        }
+        std::vector<std::pair<size_t, size_t>> chunks;
+        for (size_t i = 0; i < batch->images.size();) {
+            // Only images without pixels yet still need decoding
+            if (!batch->images[i].pixels.empty()) {
+                i++;
+                continue;
+            }
+            const size_t end = std::min(i + images_per_chunk, batch->images.size());
+            chunks.emplace_back(i, end);
+            i = end;
+        }
+        if (chunks.empty()) {
+            UploadBatch(device, *batch);
+            return;
+        }
+        batch->chunks_left = chunks.size();
+        for (const auto& [begin, end] : chunks) {
+            Resources::EnqueueWorkerTask([batch, begin, end] {
+                for (size_t i = begin; i < end; i++) {
+                    auto& staged = batch->images[i];
+                    if (!staged.pixels.empty()) {
+                        continue;
+                    }
+                    staged.pixels.resize(static_cast<size_t>(staged.img->m_dims.x) * staged.img->m_dims.y);
+                    DecodeDxt(staged.bits, staged.format, staged.img->m_dims.x, staged.img->m_dims.y, staged.pixels.data());
+                }
+                if (--batch->chunks_left == 0) {
+                    Resources::EnqueueDxTask([batch](IDirect3DDevice9* device) {
+                        UploadBatch(device, *batch);
+                    });
+                }
+            }, Resources::WorkerPriority::High);
+        }
+    }
+
+    // Queue the image for the next batch; the batch goes out on the next frame, collecting every request made until then
+    void QueueDecode(GwImg* img)
+    {
+        std::lock_guard lock(pending_mutex);
+        pending_images.push_back(img);
+        if (!batch_scheduled) {
+            batch_scheduled = true;
+            Resources::EnqueueDxTask(DecodePending);
+        }
+    }
 
     std::map<uint32_t,GwImg*> textures_by_file_id;
 }
@@ -249,9 +502,12 @@ IDirect3DTexture9** GwDatTextureModule::LoadTextureFromFileId(uint32_t file_id)
         return &found->second->m_tex;
     auto gwimg_ptr = new GwImg(file_id);
     textures_by_file_id[file_id] = gwimg_ptr;
-    Resources::Instance().EnqueueDxTask([gwimg_ptr](IDirect3DDevice9* device) {
-        gwimg_ptr->m_tex = CreateTexture(device, gwimg_ptr->m_file_id, gwimg_ptr->m_dims);
-        });
+    const auto load = [gwimg_ptr] {
+        QueueDecode(gwimg_ptr);
+    };
+    // May be unloaded again when GW textures go over budget; load() brings it back
+    TextureResidency::Track(&gwimg_ptr->m_tex, load);
+    load();
     return &gwimg_ptr->m_tex;
 }
 void GwDatTextureModule::Terminate()
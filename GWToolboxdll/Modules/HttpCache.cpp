@@ -0,0 +1,465 @@
+#include "stdafx.h"
+
+#include <wolfssl/wolfcrypt/sha256.h>
+
+#include <ImGuiAddons.h>
+
+#include <Modules/HttpCache.h>
+#include <Modules/Resources.h>
+
+namespace {
+    constexpr uint32_t index_magic = 0x49435448; // "HTCI"
+    constexpr uint32_t index_version = 1;
+    // Index is rewritten at most this often while running, and always on terminate.
+    constexpr auto index_save_interval = std::chrono::seconds(60);
+
+    struct Entry {
+        std::string url;
+        HttpCache::Validators validators;
+        int64_t fetched = 0; // Unix time the body was last known to be up to date
+        uint64_t size = 0;
+    };
+
+    std::mutex cache_mutex;
+    // Most recently used at the front; saved in this order so it survives a restart.
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+    uint64_t total_bytes = 0;
+    HttpCache::Stats stats;
+    int max_size_mb = 256; // Written on the main thread under cache_mutex
+
+    bool index_dirty = false;
+    std::chrono::steady_clock::time_point index_saved_at;
+    std::mutex index_file_mutex;
+
+    int64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::filesystem::path CacheFolder()
+    {
+        return Resources::GetPath(L"cache");
+    }
+
+    std::filesystem::path IndexPath()
+    {
+        return CacheFolder() / L"index.bin";
+    }
+
+    // SHA-256 of the url without its protocol, same naming the cache has always used.
+    std::filesystem::path BodyPath(const std::string& url)
+    {
+        std::string_view name = url;
+        for (const std::string_view protocol : {"http://", "https://"}) {
+            if (name.starts_with(protocol)) {
+                name.remove_prefix(protocol.size());
+                break;
+            }
+        }
+        byte hash[WC_SHA256_DIGEST_SIZE];
+        wc_Sha256Hash(reinterpret_cast<const byte*>(name.data()), static_cast<word32>(name.size()), hash);
+        std::string hex;
+        hex.reserve(sizeof(hash) * 2);
+        for (const auto b : hash) {
+            hex += std::format("{:02x}", b);
+        }
+        return CacheFolder() / hex;
+    }
+
+    // Memory mapped rather than streamed; FILE_SHARE_DELETE so an eviction on another thread doesn't have to wait for us.
+    bool ReadWholeFile(const std::filesystem::path& path, std::string& out)
+    {
+        const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        bool ok = GetFileSizeEx(file, &size) && !size.HighPart;
+        if (ok && size.LowPart) {
+            const HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            const auto view = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            ok = view != nullptr;
+            if (view) {
+                out.assign(view, size.LowPart);
+                UnmapViewOfFile(view);
+            }
+            if (mapping) {
+                CloseHandle(mapping);
+            }
+        }
+        else if (ok) {
+            out.clear();
+        }
+        CloseHandle(file);
+        return ok;
+    }
+
+    // Written next to the destination and renamed over it, so a reader never sees half a file.
+    bool WriteFileAtomic(const std::filesystem::path& path, const std::string& content)
+    {
+        auto tmp = path;
+        tmp += std::format(L".{}.tmp", GetCurrentThreadId());
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            if (!out.write(content.data(), static_cast<std::streamsize>(content.size()))) {
+                out.close();
+                std::error_code ec;
+                std::filesystem::remove(tmp, ec);
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+        return true;
+    }
+
+    bool EqualsNoCase(const std::string_view a, const std::string_view b)
+    {
+        return std::ranges::equal(a, b, [](const char l, const char r) {
+            return tolower(static_cast<unsigned char>(l)) == tolower(static_cast<unsigned char>(r));
+        });
+    }
+
+    // The raw header holds every response we went through (redirects, 100 Continue); only the last one counts.
+    HttpCache::Validators ParseValidators(const std::string& header)
+    {
+        HttpCache::Validators validators;
+        for (const auto line_range : std::views::split(std::string_view(header), '\n')) {
+            std::string_view line(line_range.begin(), line_range.end());
+            while (!line.empty() && isspace(static_cast<unsigned char>(line.back()))) {
+                line.remove_suffix(1);
+            }
+            if (line.starts_with("HTTP/")) {
+                validators = {};
+                continue;
+            }
+            const auto colon = line.find(':');
+            if (colon == std::string_view::npos) {
+                continue;
+            }
+            const auto name = line.substr(0, colon);
+            auto value = line.substr(colon + 1);
+            while (!value.empty() && isspace(static_cast<unsigned char>(value.front()))) {
+                value.remove_prefix(1);
+            }
+            if (EqualsNoCase(name, "etag")) {
+                validators.etag = value;
+            }
+            else if (EqualsNoCase(name, "last-modified")) {
+                validators.last_modified = value;
+            }
+        }
+        return validators;
+    }
+
+    void WriteU32(std::string& out, const uint32_t value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void WriteU64(std::string& out, const uint64_t value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void WriteString(std::string& out, const std::string& value)
+    {
+        WriteU32(out, static_cast<uint32_t>(value.size()));
+        out += value;
+    }
+
+    template <typename T>
+    bool ReadValue(std::string_view& in, T& value)
+    {
+        if (in.size() < sizeof(T)) {
+            return false;
+        }
+        memcpy(&value, in.data(), sizeof(T));
+        in.remove_prefix(sizeof(T));
+        return true;
+    }
+
+    bool ReadString(std::string_view& in, std::string& value)
+    {
+        uint32_t size;
+        if (!ReadValue(in, size) || in.size() < size) {
+            return false;
+        }
+        value = in.substr(0, size);
+        in.remove_prefix(size);
+        return true;
+    }
+
+    void SaveIndex(const bool force)
+    {
+        std::string buffer;
+        {
+            std::lock_guard lock(cache_mutex);
+            const auto now = std::chrono::steady_clock::now();
+            if (!index_dirty || (!force && now - index_saved_at < index_save_interval)) {
+                return;
+            }
+            index_dirty = false;
+            index_saved_at = now;
+            WriteU32(buffer, index_magic);
+            WriteU32(buffer, index_version);
+            WriteU32(buffer, static_cast<uint32_t>(lru.size()));
+            for (const auto& entry : lru) {
+                WriteString(buffer, entry.url);
+                WriteString(buffer, entry.validators.etag);
+                WriteString(buffer, entry.validators.last_modified);
+                WriteU64(buffer, static_cast<uint64_t>(entry.fetched));
+                WriteU64(buffer, entry.size);
+            }
+        }
+        std::lock_guard lock(index_file_mutex);
+        if (!WriteFileAtomic(IndexPath(), buffer)) {
+            Log::Log("Failed to save http cache index\n");
+        }
+    }
+
+    void LoadIndex()
+    {
+        std::string buffer;
+        std::unordered_set<std::wstring> known_files;
+        std::lock_guard lock(cache_mutex);
+        if (ReadWholeFile(IndexPath(), buffer)) {
+            std::string_view in = buffer;
+            uint32_t magic = 0, version = 0, count = 0;
+            if (ReadValue(in, magic) && magic == index_magic && ReadValue(in, version) && version == index_version && ReadValue(in, count)) {
+                for (uint32_t i = 0; i < count; i++) {
+                    Entry entry;
+                    uint64_t fetched = 0;
+                    if (!(ReadString(in, entry.url) && ReadString(in, entry.validators.etag) && ReadString(in, entry.validators.last_modified)
+                          && ReadValue(in, fetched) && ReadValue(in, entry.size))) {
+                        break;
+                    }
+                    entry.fetched = static_cast<int64_t>(fetched);
+                    // Body gone or changed behind our back; forget about it
+                    const auto path = BodyPath(entry.url);
+                    std::error_code ec;
+                    if (std::filesystem::file_size(path, ec) != entry.size || ec || entries.contains(entry.url)) {
+                        continue;
+                    }
+                    known_files.insert(path.filename().wstring());
+                    total_bytes += entry.size;
+                    lru.push_back(std::move(entry));
+                    entries.emplace(lru.back().url, std::prev(lru.end()));
+                }
+            }
+        }
+        // Anything else in the folder isn't accounted for; e.g. files from before there was an index.
+        std::error_code ec;
+        for (const auto& file : std::filesystem::directory_iterator(CacheFolder(), ec)) {
+            const auto name = file.path().filename().wstring();
+            if (file.is_regular_file(ec) && name != IndexPath().filename().wstring() && !known_files.contains(name)) {
+                std::filesystem::remove(file.path(), ec);
+            }
+        }
+    }
+
+    // Caller holds cache_mutex
+    void Remove(const std::list<Entry>::iterator it)
+    {
+        std::error_code ec;
+        std::filesystem::remove(BodyPath(it->url), ec);
+        total_bytes -= it->size;
+        entries.erase(it->url);
+        lru.erase(it);
+        index_dirty = true;
+    }
+
+    // Caller holds cache_mutex
+    void Evict()
+    {
+        const auto max_bytes = static_cast<uint64_t>(max_size_mb) * 1024 * 1024;
+        while (total_bytes > max_bytes && !lru.empty()) {
+            Remove(std::prev(lru.end()));
+            stats.evictions++;
+        }
+    }
+
+    void Forget(const std::string& url)
+    {
+        std::lock_guard lock(cache_mutex);
+        const auto found = entries.find(url);
+        if (found != entries.end()) {
+            Remove(found->second);
+        }
+    }
+}
+
+void HttpCache::Initialize()
+{
+    ToolboxModule::Initialize();
+    Resources::EnsureFolderExists(CacheFolder());
+    LoadIndex();
+}
+
+void HttpCache::Terminate()
+{
+    ToolboxModule::Terminate();
+    SaveIndex(true);
+}
+
+void HttpCache::LoadSettings(ToolboxIni* ini)
+{
+    ToolboxModule::LoadSettings(ini);
+    std::lock_guard lock(cache_mutex);
+    max_size_mb = std::max(static_cast<int>(ini->GetLongValue(Name(), "max_size_mb", max_size_mb)), 1);
+    Evict();
+}
+
+void HttpCache::SaveSettings(ToolboxIni* ini)
+{
+    ToolboxModule::SaveSettings(ini);
+    ini->SetLongValue(Name(), "max_size_mb", max_size_mb);
+}
+
+void HttpCache::DrawSettingsInternal()
+{
+    ImGui::Text("Download cache:");
+    ImGui::ShowHelp("Wiki pages and other responses Toolbox keeps on disk so it doesn't have to download them again.\n"
+                    "Least recently used responses are removed once the cache grows past the max size.");
+    const float btnWidth = 180.0f * ImGui::GetIO().FontGlobalScale;
+    ImGui::SameLine(ImGui::GetContentRegionAvail().x - btnWidth);
+    if (ImGui::Button("Clear cache", ImVec2(btnWidth, 0))) {
+        Resources::EnqueueWorkerTask(Clear);
+    }
+    int size_mb = max_size_mb;
+    if (ImGui::InputInt("Max size (MB)", &size_mb, 16, 128)) {
+        std::lock_guard lock(cache_mutex);
+        max_size_mb = std::max(size_mb, 1);
+        Evict();
+    }
+    const auto current = GetStats();
+    const auto requests = current.hits + current.revalidated + current.misses + current.stale_served;
+    ImGui::Text("%zu responses, %.1f MB", current.entries, static_cast<double>(current.bytes) / (1024 * 1024));
+    ImGui::Text("%zu hits, %zu revalidated, %zu misses, %zu stale, %zu evicted (%.0f%% served from disk)",
+                current.hits, current.revalidated, current.misses, current.stale_served, current.evictions,
+                requests ? 100.0 * static_cast<double>(requests - current.misses) / static_cast<double>(requests) : 0.0);
+    ImGui::Text("%zu downloads shared a transfer already in flight", Resources::GetDeduplicatedDownloads());
+}
+
+HttpCache::LookupResult HttpCache::Lookup(const std::string& url, const std::chrono::seconds max_age, std::string& body, Validators& validators)
+{
+    {
+        std::lock_guard lock(cache_mutex);
+        const auto found = entries.find(url);
+        if (found == entries.end()) {
+            stats.misses++;
+            return LookupResult::Miss;
+        }
+        lru.splice(lru.begin(), lru, found->second);
+        const Entry& entry = *found->second;
+        if (Now() - entry.fetched >= max_age.count()) {
+            validators = entry.validators;
+            return LookupResult::Stale;
+        }
+    }
+    if (!ReadWholeFile(BodyPath(url), body)) {
+        Forget(url);
+        std::lock_guard lock(cache_mutex);
+        stats.misses++;
+        return LookupResult::Miss;
+    }
+    std::lock_guard lock(cache_mutex);
+    stats.hits++;
+    return LookupResult::Fresh;
+}
+
+bool HttpCache::Revalidated(const std::string& url, std::string& body)
+{
+    {
+        std::lock_guard lock(cache_mutex);
+        const auto found = entries.find(url);
+        if (found == entries.end()) {
+            return false;
+        }
+        found->second->fetched = Now();
+        index_dirty = true;
+    }
+    if (!ReadWholeFile(BodyPath(url), body)) {
+        Forget(url);
+        return false;
+    }
+    {
+        std::lock_guard lock(cache_mutex);
+        stats.revalidated++;
+    }
+    SaveIndex(false);
+    return true;
+}
+
+void HttpCache::Store(const std::string& url, const std::string& header, const std::string& body)
+{
+    if (!WriteFileAtomic(BodyPath(url), body)) {
+        Forget(url);
+        return;
+    }
+    {
+        std::lock_guard lock(cache_mutex);
+        auto found = entries.find(url);
+        if (found == entries.end()) {
+            lru.emplace_front();
+            lru.front().url = url;
+            found = entries.emplace(url, lru.begin()).first;
+        }
+        else {
+            // Stale and the server sent a new body; Lookup didn't count it
+            stats.misses++;
+            total_bytes -= found->second->size;
+            lru.splice(lru.begin(), lru, found->second);
+        }
+        Entry& entry = *found->second;
+        entry.validators = ParseValidators(header);
+        entry.fetched = Now();
+        entry.size = body.size();
+        total_bytes += entry.size;
+        index_dirty = true;
+        Evict();
+    }
+    SaveIndex(false);
+}
+
+bool HttpCache::ServeStale(const std::string& url, std::string& body)
+{
+    {
+        std::lock_guard lock(cache_mutex);
+        if (!entries.contains(url)) {
+            return false;
+        }
+    }
+    if (!ReadWholeFile(BodyPath(url), body)) {
+        Forget(url);
+        return false;
+    }
+    std::lock_guard lock(cache_mutex);
+    stats.stale_served++;
+    return true;
+}
+
+void HttpCache::Clear()
+{
+    {
+        std::lock_guard lock(cache_mutex);
+        while (!lru.empty()) {
+            Remove(lru.begin());
+        }
+    }
+    SaveIndex(true);
+}
+
+HttpCache::Stats HttpCache::GetStats()
+{
+    std::lock_guard lock(cache_mutex);
+    auto current = stats;
+    current.entries = lru.size();
+    current.bytes = total_bytes;
+    return current;
+}
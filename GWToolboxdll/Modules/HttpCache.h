@@ -0,0 +1,58 @@
+#pragma once
+
+#include <ToolboxModule.h>
+
+// On-disk cache for Resources::Download(url, callback, context, cache_duration).
+// Bodies live in the "cache" folder, one file per url; everything else is kept in a single index file.
+class HttpCache : public ToolboxModule {
+    HttpCache() = default;
+    ~HttpCache() override = default;
+
+public:
+    static HttpCache& Instance()
+    {
+        static HttpCache instance;
+        return instance;
+    }
+
+    [[nodiscard]] const char* Name() const override { return "HTTP Cache"; }
+    // DrawSettingInternal() called via ToolboxSettings; don't draw it again
+    bool HasSettings() override { return false; }
+
+    void Initialize() override;
+    void Terminate() override;
+    void LoadSettings(ToolboxIni* ini) override;
+    void SaveSettings(ToolboxIni* ini) override;
+    void DrawSettingsInternal() override;
+
+    enum class LookupResult {
+        Miss,
+        Fresh, // body is filled in
+        Stale  // validators are filled in; revalidate, then call Revalidated or Store
+    };
+    struct Validators {
+        std::string etag;
+        std::string last_modified;
+    };
+    struct Stats {
+        size_t hits = 0; // Served from disk without a request
+        size_t revalidated = 0; // Server answered 304 Not Modified
+        size_t misses = 0; // Had to download the whole body
+        size_t stale_served = 0; // Download failed, served the old body instead
+        size_t evictions = 0;
+        size_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    // All of these are thread-safe and touch the disk; call them from a worker.
+    static LookupResult Lookup(const std::string& url, std::chrono::seconds max_age, std::string& body, Validators& validators);
+    // Server answered 304 for a Stale entry; refreshes it and reads the body back.
+    static bool Revalidated(const std::string& url, std::string& body);
+    // Server sent a new body; header is the raw response header, used to pick up ETag/Last-Modified.
+    static void Store(const std::string& url, const std::string& header, const std::string& body);
+    // Revalidation failed; reads back whatever we had for the url, however old.
+    static bool ServeStale(const std::string& url, std::string& body);
+    static void Clear();
+
+    static Stats GetStats();
+};
@@ -1,5 +1,7 @@
 #include "stdafx.h"
 
+#include <atomic>
+
 #include <GWCA/Packets/StoC.h>
 
 #include <GWCA/GameEntities/Guild.h>
@@ -21,6 +23,7 @@
 
 #include <Modules/ChatSettings.h>
 #include <Modules/Obfuscator.h>
+#include <Utils/AhoCorasick.h>
 #include <Utils/GuiUtils.h>
 #include <Windows/FriendListWindow.h>
 
@@ -266,6 +269,41 @@ namespace {
     std::map<std::wstring, std::wstring> obfuscated_by_obfuscation;
     // List of obfuscated names, keyed by original
     std::map<std::wstring, std::wstring> obfuscated_by_original;
+
+    // Every name in one of the maps above compiled into one matcher, so ObfuscateMessage finds them all in a single pass
+    struct NameSubstitutions {
+        AhoCorasick matcher;
+        std::vector<size_t> lengths; // By pattern index
+        std::vector<std::wstring> replacements;
+
+        void Build(const std::map<std::wstring, std::wstring>& names)
+        {
+            std::vector<std::wstring> patterns;
+            lengths.clear();
+            replacements.clear();
+            for (const auto& [from, to] : names) {
+                patterns.push_back(from);
+                lengths.push_back(from.length());
+                replacements.push_back(to);
+            }
+            matcher.Build(patterns);
+        }
+    };
+    struct Substitutions {
+        NameSubstitutions obfuscate;
+        NameSubstitutions unobfuscate;
+    };
+    // Rebuilt whenever obfuscated_by_original/obfuscated_by_obfuscation change and swapped in whole,
+    // so ObfuscateMessage on any thread always works on a complete set
+    std::atomic<std::shared_ptr<const Substitutions>> substitutions;
+
+    void PublishSubstitutions()
+    {
+        const auto built = std::make_shared<Substitutions>();
+        built->obfuscate.Build(obfuscated_by_original);
+        built->unobfuscate.Build(obfuscated_by_obfuscation);
+        substitutions.store(built);
+    }
     // Current position in the list of obfuscated names
     size_t pool_index = 0;
 
@@ -330,7 +368,8 @@ namespace {
 
     bool ObfuscateName(const std::wstring& _original_name, std::wstring& out, const bool in_char_select = false)
     {
-        std::wstring original_name = GuiUtils::SanitizePlayerName(_original_name);
+        thread_local std::wstring original_name;
+        GuiUtils::SanitizePlayerName(_original_name, original_name);
         if (_original_name.empty()) {
             return false;
         }
@@ -358,6 +397,7 @@ namespace {
         if (!obfuscated_by_original.contains(original_name)) {
             obfuscated_by_obfuscation.emplace(tmp_out, original_name);
             obfuscated_by_original.emplace(original_name, tmp_out);
+            PublishSubstitutions();
             out.assign(tmp_out);
             return true;
         }
@@ -369,7 +409,8 @@ namespace {
         if (_obfuscated_name.empty()) {
             return false;
         }
-        const auto obfuscated_name = GuiUtils::SanitizePlayerName(std::wstring(_obfuscated_name));
+        thread_local std::wstring obfuscated_name;
+        GuiUtils::SanitizePlayerName(_obfuscated_name, obfuscated_name);
         const auto found = obfuscated_by_obfuscation.find(obfuscated_name);
         if (found == obfuscated_by_obfuscation.end()) {
             return false;
@@ -382,22 +423,37 @@ namespace {
     {
         if (!wcschr(message.data(),0x107))
             return false; // Message contains no player names
-        std::wstring replacemsg{message};
-        const auto& to_search = obfuscate ? obfuscated_by_original : obfuscated_by_obfuscation;
-        bool was_changed = false;
-        for (const auto& [from, to] : to_search) {
-            if (from.empty()) {
-                break;
-            }
-            size_t start_pos = 0;
-            while ((start_pos = replacemsg.find(from, start_pos)) != std::string::npos) {
-                replacemsg.replace(start_pos, from.length(), to);
-                start_pos += to.length(); // In case 'to' contains 'from', like replacing 'x' with 'yx'
-                was_changed = true;
+        const auto current = substitutions.load();
+        if (!current) {
+            return false; // No names yet
+        }
+        const auto& names = obfuscate ? current->obfuscate : current->unobfuscate;
+
+        // Every occurrence of every name as (start, pattern), then replace the leftmost, longest ones that don't overlap.
+        // Replacements go into a separate buffer, so a replacement is never searched again for other names.
+        thread_local std::vector<std::pair<size_t, uint32_t>> matches;
+        thread_local std::wstring replacemsg;
+        matches.clear();
+        names.matcher.ForEachMatch(message, [&names](const uint32_t pattern, const size_t end) {
+            matches.emplace_back(end - names.lengths[pattern], pattern);
+            return true;
+        });
+        std::ranges::sort(matches, [&names](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first < b.first : names.lengths[a.second] > names.lengths[b.second];
+        });
+        replacemsg.clear();
+        size_t copied = 0;
+        for (const auto& [start, pattern] : matches) {
+            if (start < copied) {
+                continue; // Overlaps a name already replaced
             }
+            replacemsg.append(message.substr(copied, start - copied));
+            replacemsg.append(names.replacements[pattern]);
+            copied = start + names.lengths[pattern];
         }
+        replacemsg.append(message.substr(copied));
         out.assign(replacemsg);
-        return !out.empty() && was_changed;
+        return !out.empty() && copied != 0;
     }
 
     bool UnobfuscateMessage(const wchar_t* message, std::wstring& out)
@@ -550,6 +606,7 @@ namespace {
         pool_index = 0;
         obfuscated_by_obfuscation.clear();
         obfuscated_by_original.clear();
+        PublishSubstitutions();
         // Don't use clear() on this; the game uses the pointer so we don't want to mess with it
         account_info_obfuscated_name[0] = '\0';
         // Don't use clear() on this; the game uses the pointer so we don't want to mess with it
@@ -1,7 +1,11 @@
 #include "stdafx.h"
 
+#include <atomic>
+#include <condition_variable>
+
 #include <DDSTextureLoader/DDSTextureLoader9.h>
-#include <WICTextureLoader/WICTextureLoader9.h>
+#include <wincodec.h>
+#include <wrl/client.h>
 
 #include <GWCA/GameEntities/Map.h>
 #include <GWCA/GameEntities/Item.h>
@@ -19,13 +23,15 @@
 #include <Str.h>
 
 #include <GWCA/Constants/Constants.h>
+#include <Modules/HttpCache.h>
 #include <Modules/Resources.h>
+#include <Modules/TextureResidency.h>
 #include <Utils/GuiUtils.h>
+#include <Utils/TextureAtlas.h>
 
 #include <include/nfd.h>
 #include <nfd_common.c>
 #include <nfd_win.cpp>
-#include <wolfssl/wolfcrypt/asn.h>
 
 #include "GwDatTextureModule.h"
 #include "GWCA/GameEntities/Skill.h"
@@ -92,12 +98,23 @@ namespace {
     const wchar_t* PROF_ICONS_PATH = L"img\\professions";
     const wchar_t* DMGTYPE_ICONS_PATH = L"img\\damagetypes";
 
-    std::recursive_mutex worker_mutex;
+    std::mutex worker_mutex;
     std::recursive_mutex main_mutex;
     std::recursive_mutex dx_mutex;
 
-    // tasks to be done async by the worker thread
-    std::queue<std::function<void()>> thread_jobs;
+    struct WorkerTask {
+        std::function<void()> func;
+        std::chrono::steady_clock::time_point queued_at;
+        // Still run when the workers stop with it queued, because someone is waiting on it
+        bool run_on_stop = false;
+    };
+    // tasks to be done async by the worker thread, one queue per Resources::WorkerPriority. Guarded by worker_mutex.
+    std::array<std::deque<WorkerTask>, static_cast<size_t>(Resources::WorkerPriority::Count)> thread_jobs;
+    // signalled when a worker task is queued or the workers should stop
+    std::condition_variable worker_cv;
+    Resources::WorkerQueueStats worker_stats;
+    std::chrono::microseconds worker_total_wait{};
+    size_t worker_started = 0; // Tasks picked up by a worker, for avg_wait
     // tasks to be done in the render thread
     std::queue<std::function<void(IDirect3DDevice9*)>> dx_jobs;
     // tasks to be done in main thread
@@ -136,19 +153,43 @@ namespace {
 
     void WorkerUpdate()
     {
-        while (!should_stop) {
-            worker_mutex.lock();
-            if (thread_jobs.empty()) {
-                worker_mutex.unlock();
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        while (true) {
+            std::unique_lock lock(worker_mutex);
+            const auto jobs = std::ranges::find_if(thread_jobs, [](const auto& queue) { return !queue.empty(); });
+            if (should_stop) {
+                return;
             }
-            else {
-                std::function<void()> func = thread_jobs.front();
-                thread_jobs.pop();
-                worker_mutex.unlock();
-                func();
+            if (jobs == thread_jobs.end()) {
+                worker_cv.wait(lock);
+                continue;
+            }
+            const WorkerTask task = std::move(jobs->front());
+            jobs->pop_front();
+
+            const auto waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - task.queued_at);
+            worker_total_wait += waited;
+            worker_started++;
+            worker_stats.avg_wait = worker_total_wait / worker_started;
+            worker_stats.max_wait = std::max(worker_stats.max_wait, waited);
+            lock.unlock();
+            task.func();
+            lock.lock();
+            worker_stats.completed++;
+        }
+    }
+
+    void QueueWorkerTask(WorkerTask&& task, const Resources::WorkerPriority priority)
+    {
+        {
+            std::lock_guard lock(worker_mutex);
+            thread_jobs[static_cast<size_t>(priority)].push_back(std::move(task));
+            size_t pending = 0;
+            for (const auto& queue : thread_jobs) {
+                pending += queue.size();
             }
+            worker_stats.max_pending = std::max(worker_stats.max_pending, pending);
         }
+        worker_cv.notify_one();
     }
 
     void InitRestClient(RestClient* r)
@@ -161,6 +202,400 @@ namespace {
         r->SetMethod(HttpMethod::Get);
         r->SetVerifyHost(false);
     }
+
+    bool ReadResponse(RestClient& r, const std::string& url, std::string& response)
+    {
+        if (!r.IsSuccessful()) {
+            StrSprintf(response, "Failed to download %s, curl status %d %s", url.c_str(), r.GetStatusCode(), r.GetStatusStr());
+            return false;
+        }
+        response = std::move(r.GetContent());
+        return true;
+    }
+
+    // The body was streamed to path_to_file by CurlEasy; the file is only there if the transfer succeeded.
+    bool ReadFileResponse(RestClient& r, const std::filesystem::path& path_to_file, const std::string& url, std::wstring& response)
+    {
+        std::string error;
+        if (!ReadResponse(r, url, error)) {
+            return StrSwprintf(response, L"%S", error.c_str()), false;
+        }
+        if (!r.GetDownloadFileSize()) {
+            return StrSwprintf(response, L"Failed to download %S, no content length", url.c_str()), false;
+        }
+        return true;
+    }
+
+    // Transfers are multiplexed on the shared curl thread instead of tying up a worker each; when one finishes,
+    // on_done is run as a worker task of the request's priority, then the request deletes itself.
+    class AsyncDownload : public AsyncRestClient {
+    public:
+        using OnDone = std::function<void(RestClient& r)>;
+
+        // headers are "Name: Value". With a download_file the body is streamed to disk instead of memory;
+        // false if that file can't be opened, in which case on_done is never called.
+        static bool Start(const std::string& url, OnDone _on_done, const Resources::WorkerPriority _priority, const std::vector<std::string>& headers = {},
+                          const std::filesystem::path& download_file = {})
+        {
+            const auto download = new AsyncDownload(std::move(_on_done), _priority);
+            InitRestClient(download);
+            download->SetUrl(url.c_str());
+            for (const auto& header : headers) {
+                download->SetHeader(header.c_str());
+            }
+            if (!download_file.empty() && !download->SetDownloadFile(download_file)) {
+                delete download;
+                return false;
+            }
+            download->ExecuteAsync();
+            return true;
+        }
+
+    private:
+        AsyncDownload(OnDone&& _on_done, const Resources::WorkerPriority _priority)
+            : on_done(std::move(_on_done)), priority(_priority) {}
+
+        // Curl thread; keep it short.
+        void OnPerformed() override
+        {
+            // Run even at shutdown, so callers waiting on the transfer are told it failed
+            QueueWorkerTask({[this] {
+                Wait(); // OnPerformed is called just before the request is flagged as done
+                on_done(*this);
+                delete this;
+            }, std::chrono::steady_clock::now(), true}, priority);
+        }
+
+        OnDone on_done;
+        Resources::WorkerPriority priority;
+    };
+
+    std::atomic<size_t> deduplicated_downloads = 0;
+
+    // Single-flight: a request for something that's already being fetched waits for that transfer instead of
+    // starting its own, and every waiter gets the result.
+    template <typename... Args>
+    class InFlightDownloads {
+    public:
+        using Waiter = std::function<void(Args...)>;
+
+        // True if nothing was in flight for key, i.e. the caller has to start the transfer and call Finish when done.
+        bool Join(const std::string& key, Waiter waiter)
+        {
+            std::lock_guard lock(mutex);
+            auto& waiters = in_flight[key];
+            waiters.push_back(std::move(waiter));
+            if (waiters.size() == 1) {
+                return true;
+            }
+            deduplicated_downloads++;
+            return false;
+        }
+
+        void Finish(const std::string& key, Args... args)
+        {
+            std::vector<Waiter> waiters;
+            {
+                std::lock_guard lock(mutex);
+                const auto found = in_flight.find(key);
+                if (found == in_flight.end()) {
+                    return;
+                }
+                waiters = std::move(found->second);
+                in_flight.erase(found);
+            }
+            for (const auto& waiter : waiters) {
+                waiter(args...);
+            }
+        }
+
+    private:
+        std::mutex mutex;
+        std::unordered_map<std::string, std::vector<Waiter>> in_flight;
+    };
+
+    // Keyed by url, or "cache:" + url for cached downloads since those may be answered from disk.
+    InFlightDownloads<bool, const std::string&> memory_downloads;
+    // Keyed by destination path; two requests writing the same file have to share one transfer anyway.
+    InFlightDownloads<bool, const std::wstring&> file_downloads;
+
+    // Worker thread.
+    void FetchCached(const std::string& url, const std::chrono::seconds cache_duration, const std::function<void(bool ok, const std::string& response)>& done)
+    {
+        std::string response;
+        HttpCache::Validators validators;
+        if (HttpCache::Lookup(url, cache_duration, response, validators) == HttpCache::LookupResult::Fresh) {
+            done(true, response);
+            return;
+        }
+        // Stale entries are revalidated; if the server says 304 we read back what we have instead of downloading it again.
+        std::vector<std::string> headers;
+        if (!validators.etag.empty()) {
+            headers.push_back("If-None-Match: " + validators.etag);
+        }
+        if (!validators.last_modified.empty()) {
+            headers.push_back("If-Modified-Since: " + validators.last_modified);
+        }
+        AsyncDownload::Start(url, [url, cache_duration, done](RestClient& r) {
+            std::string response;
+            bool ok = false;
+            if (r.GetStatus() == ResponseStatus::Completed && r.GetStatusCode() == 304) {
+                ok = HttpCache::Revalidated(url, response);
+                if (!ok) {
+                    // Evicted while we were asking; start over without validators
+                    FetchCached(url, cache_duration, done);
+                    return;
+                }
+            }
+            else if (ReadResponse(r, url, response)) {
+                ok = true;
+                HttpCache::Store(url, r.GetHeader(), response);
+            }
+            else {
+                // Better an old page than none at all
+                std::string stale;
+                ok = HttpCache::ServeStale(url, stale);
+                if (ok) {
+                    response = std::move(stale);
+                }
+            }
+            done(ok, response);
+        }, Resources::WorkerPriority::Normal, headers);
+    }
+
+    // A texture read and decoded on a worker, waiting in staged_textures for DxUpdate to upload it
+    struct StagedTexture {
+        IDirect3DTexture9** texture = nullptr;
+        Resources::AsyncLoadCallback callback;
+        std::wstring source; // For error messages e.g. "file <path>" or "resource id <id>"
+        std::wstring error; // Set if the texture couldn't be read or decoded; nothing to upload
+        std::vector<uint8_t> dds; // Either a .dds file to upload as is...
+        bool dds_generate_mips = false;
+        std::vector<uint8_t> pixels; // ...or 32bpp BGRA rows, width * 4 bytes each
+        UINT width = 0;
+        UINT height = 0;
+    };
+    std::mutex staged_textures_mutex;
+    std::queue<StagedTexture> staged_textures;
+    // DxUpdate stops uploading for this frame once it has spent this long; at least one texture goes up every frame regardless.
+    constexpr auto texture_upload_budget = std::chrono::microseconds(2000);
+    // Images bigger than this are scaled down while decoding
+    constexpr UINT max_texture_size = 4096;
+
+    Resources::FrameStats frame_stats;
+    std::chrono::steady_clock::time_point last_frame;
+
+    size_t FrameTimeBucket(const std::chrono::steady_clock::duration duration)
+    {
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        const auto clamped = static_cast<uint32_t>(std::clamp<int64_t>(us, 0, UINT32_MAX));
+        return static_cast<size_t>(std::ranges::lower_bound(Resources::frame_time_buckets, clamped) - Resources::frame_time_buckets.begin());
+    }
+
+    bool ReadFileBytes(const std::filesystem::path& path, std::vector<uint8_t>& out)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            return false;
+        }
+        const std::streamoff size = file.tellg();
+        if (size <= 0) {
+            return false;
+        }
+        out.resize(static_cast<size_t>(size));
+        file.seekg(0);
+        return file.read(reinterpret_cast<char*>(out.data()), size).good();
+    }
+
+    // Decode any image WIC understands into staged.pixels. Runs on a worker, so does its own COM init like ResolveShortcut.
+    HRESULT DecodeImage(const uint8_t* data, const size_t size, StagedTexture& staged)
+    {
+        const HRESULT init = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+        if (FAILED(init) && init != RPC_E_CHANGED_MODE) {
+            return init;
+        }
+        const HRESULT res = [&] {
+            using Microsoft::WRL::ComPtr;
+            ComPtr<IWICImagingFactory> factory;
+            HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+            if (FAILED(hr)) {
+                return hr;
+            }
+            ComPtr<IWICStream> stream;
+            hr = factory->CreateStream(&stream);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            hr = stream->InitializeFromMemory(const_cast<BYTE*>(data), static_cast<DWORD>(size));
+            if (FAILED(hr)) {
+                return hr;
+            }
+            ComPtr<IWICBitmapDecoder> decoder;
+            hr = factory->CreateDecoderFromStream(stream.Get(), nullptr, WICDecodeMetadataCacheOnDemand, &decoder);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            ComPtr<IWICBitmapFrameDecode> frame;
+            hr = decoder->GetFrame(0, &frame);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            UINT width = 0;
+            UINT height = 0;
+            hr = frame->GetSize(&width, &height);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            if (!width || !height) {
+                return WINCODEC_ERR_IMAGESIZEOUTOFRANGE;
+            }
+            ComPtr<IWICBitmapSource> source = frame;
+            if (width > max_texture_size || height > max_texture_size) {
+                const float scale = std::min(static_cast<float>(max_texture_size) / static_cast<float>(width), static_cast<float>(max_texture_size) / static_cast<float>(height));
+                width = std::max(1u, static_cast<UINT>(static_cast<float>(width) * scale));
+                height = std::max(1u, static_cast<UINT>(static_cast<float>(height) * scale));
+                ComPtr<IWICBitmapScaler> scaler;
+                hr = factory->CreateBitmapScaler(&scaler);
+                if (FAILED(hr)) {
+                    return hr;
+                }
+                hr = scaler->Initialize(source.Get(), width, height, WICBitmapInterpolationModeFant);
+                if (FAILED(hr)) {
+                    return hr;
+                }
+                source = scaler;
+            }
+            ComPtr<IWICFormatConverter> converter;
+            hr = factory->CreateFormatConverter(&converter);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            hr = converter->Initialize(source.Get(), GUID_WICPixelFormat32bppBGRA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            staged.pixels.resize(static_cast<size_t>(width) * height * 4);
+            hr = converter->CopyPixels(nullptr, width * 4, static_cast<UINT>(staged.pixels.size()), staged.pixels.data());
+            if (FAILED(hr)) {
+                staged.pixels.clear();
+                return hr;
+            }
+            staged.width = width;
+            staged.height = height;
+            return S_OK;
+        }();
+        if (SUCCEEDED(init)) {
+            CoUninitialize();
+        }
+        return res;
+    }
+
+    // Worker side; hand a decoded (or failed) texture over to the render thread
+    void StageTexture(StagedTexture&& staged)
+    {
+        std::lock_guard lock(staged_textures_mutex);
+        staged_textures.push(std::move(staged));
+    }
+
+    // Render thread side; create the texture and copy the staged image into it
+    HRESULT UploadTexture(IDirect3DDevice9* device, StagedTexture& staged)
+    {
+        IDirect3DTexture9* texture = nullptr;
+        // NB: Some Graphics cards seem to spit out D3DERR_NOTAVAILABLE when loading textures, haven't figured out why but retry if this error is reported
+        HRESULT res = D3DERR_NOTAVAILABLE;
+        size_t tries = 0;
+        while (res == D3DERR_NOTAVAILABLE && tries++ < 3) {
+            if (!staged.dds.empty()) {
+                res = DirectX::CreateDDSTextureFromMemoryEx(device, staged.dds.data(), staged.dds.size(), 0, D3DPOOL_MANAGED, staged.dds_generate_mips, &texture);
+            }
+            else {
+                res = device->CreateTexture(staged.width, staged.height, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &texture, nullptr);
+            }
+        }
+        if (res == D3D_OK && texture && staged.dds.empty()) {
+            D3DLOCKED_RECT rect;
+            res = texture->LockRect(0, &rect, nullptr, 0);
+            if (res == D3D_OK) {
+                const size_t row_size = static_cast<size_t>(staged.width) * 4;
+                for (UINT y = 0; y < staged.height; y++) {
+                    memcpy(static_cast<uint8_t*>(rect.pBits) + static_cast<size_t>(y) * rect.Pitch, staged.pixels.data() + y * row_size, row_size);
+                }
+                texture->UnlockRect(0);
+            }
+        }
+        if (res != D3D_OK) {
+            if (texture) {
+                texture->Release();
+            }
+            StrSwprintf(staged.error, L"Error loading texture from %s - Error is %S", staged.source.c_str(), d3dErrorMessage(res));
+            return res;
+        }
+        if (!texture) {
+            StrSwprintf(staged.error, L"Error loading texture from %s - texture loaded is null", staged.source.c_str());
+            return D3DERR_NOTFOUND;
+        }
+        *staged.texture = texture;
+        return D3D_OK;
+    }
+
+    // Pack a freshly loaded icon into the TextureAtlas, so windows full of icons batch into fewer draw calls
+    void AddToAtlas(IDirect3DTexture9** texture)
+    {
+        Resources::EnqueueDxTask([texture](IDirect3DDevice9* device) {
+            TextureAtlas::Add(device, *texture);
+        });
+    }
+
+    // Load an image TextureResidency may unload again; it's loaded the same way the next time it's drawn
+    void LoadTrackedTexture(IDirect3DTexture9** texture, const std::filesystem::path& path_to_file, const std::string& url, const Resources::AsyncLoadCallback& callback)
+    {
+        const auto load = [texture, path_to_file, url, callback] {
+            if (url.empty()) {
+                Resources::LoadTexture(texture, path_to_file, callback);
+            }
+            else {
+                Resources::LoadTexture(texture, path_to_file, url, callback);
+            }
+        };
+        TextureResidency::Track(texture, load);
+        load();
+    }
+
+    // Upload decoded textures until this frame's budget is spent, running callbacks as we go
+    void UploadStagedTextures(IDirect3DDevice9* device, const std::chrono::steady_clock::time_point frame_start)
+    {
+        while (true) {
+            std::unique_lock lock(staged_textures_mutex);
+            frame_stats.pending_uploads = staged_textures.size();
+            if (staged_textures.empty()) {
+                return;
+            }
+            StagedTexture staged = std::move(staged_textures.front());
+            staged_textures.pop();
+            frame_stats.pending_uploads = staged_textures.size();
+            lock.unlock();
+
+            const auto upload_start = std::chrono::steady_clock::now();
+            const bool success = staged.error.empty() && UploadTexture(device, staged) == D3D_OK;
+            const auto upload_end = std::chrono::steady_clock::now();
+            if (success) {
+                frame_stats.textures_uploaded++;
+                frame_stats.max_upload = std::max(frame_stats.max_upload, std::chrono::duration_cast<std::chrono::microseconds>(upload_end - upload_start));
+            }
+            // Free the staging memory before running the callback
+            staged.dds = {};
+            staged.pixels = {};
+            if (staged.callback) {
+                staged.callback(success, staged.error);
+            }
+            else if (!success) {
+                Log::LogW(L"Failed to load texture from %s\n%s", staged.source.c_str(), staged.error.c_str());
+            }
+            if (std::chrono::steady_clock::now() - frame_start >= texture_upload_budget) {
+                return;
+            }
+        }
+    }
 } // namespace
 
 Resources::Resources()
@@ -186,11 +621,19 @@ Resources::~Resources()
     map_names.clear();
 };
 
-void Resources::EnqueueWorkerTask(const std::function<void()>& f)
+void Resources::EnqueueWorkerTask(const std::function<void()>& f, WorkerPriority priority)
+{
+    QueueWorkerTask({f, std::chrono::steady_clock::now()}, priority);
+}
+
+Resources::WorkerQueueStats Resources::GetWorkerQueueStats()
 {
-    worker_mutex.lock();
-    thread_jobs.push(f);
-    worker_mutex.unlock();
+    std::lock_guard lock(worker_mutex);
+    auto stats = worker_stats;
+    for (size_t i = 0; i < thread_jobs.size(); i++) {
+        stats.pending[i] = thread_jobs[i].size();
+    }
+    return stats;
 }
 
 void Resources::EnqueueMainTask(const std::function<void()>& f)
@@ -230,7 +673,7 @@ void Resources::OpenFileDialog(std::function<void(const char*)> callback, const
         if (outPath) {
             free(outPath);
         }
-    });
+    }, WorkerPriority::High);
 }
 
 void Resources::SaveFileDialog(std::function<void(const char*)> callback, const char* filterList, const char* defaultPath)
@@ -258,7 +701,7 @@ void Resources::SaveFileDialog(std::function<void(const char*)> callback, const
         if (outPath) {
             free(outPath);
         }
-    });
+    }, WorkerPriority::High);
 }
 
 float Resources::GetGWScaleMultiplier(const bool force)
@@ -350,6 +793,7 @@ HRESULT Resources::ResolveShortcut(const std::filesystem::path& in_shortcut_path
 void Resources::Initialize()
 {
     ToolboxModule::Initialize();
+    InitAsyncRest();
     for (size_t i = 0; i < MAX_WORKERS; i++) {
         workers.push_back(new std::thread([this] {
             WorkerUpdate();
@@ -360,7 +804,11 @@ void Resources::Initialize()
 
 void Resources::Cleanup()
 {
-    should_stop = true;
+    {
+        std::lock_guard lock(worker_mutex);
+        should_stop = true;
+    }
+    worker_cv.notify_all();
     for (std::thread* worker : workers) {
         if (!worker) {
             continue;
@@ -370,6 +818,22 @@ void Resources::Cleanup()
         delete worker;
     }
     workers.clear();
+    // The rest of the queue is dropped, but download completions release whoever is waiting on them
+    std::vector<WorkerTask> left_over;
+    {
+        std::lock_guard lock(worker_mutex);
+        for (auto& queue : thread_jobs) {
+            for (auto& task : queue) {
+                if (task.run_on_stop) {
+                    left_over.push_back(std::move(task));
+                }
+            }
+            queue.clear();
+        }
+    }
+    for (const auto& task : left_over) {
+        task.func();
+    }
     for (const auto& tex : skill_images | std::views::values) {
         delete tex;
     }
@@ -397,14 +861,23 @@ void Resources::Terminate()
 
     GW::UI::RemoveUIMessageCallback(&OnUIMessage_Hook);
 
+    // Stop the curl thread first: it fails whatever is still in flight, and the workers joined by Cleanup
+    // then get to tell the waiters. Not in the destructor; that runs under the loader lock and joining the
+    // curl thread there would hang.
+    ShutdownAsyncRest();
     Cleanup();
+    TextureAtlas::Clear();
 }
 
 void Resources::EndLoading() const
 {
-    EnqueueWorkerTask([this] {
-        should_stop = true;
-    });
+    EnqueueWorkerTask([] {
+        {
+            std::lock_guard lock(worker_mutex);
+            should_stop = true;
+        }
+        worker_cv.notify_all();
+    }, WorkerPriority::Low);
 }
 
 std::filesystem::path Resources::GetComputerFolderPath()
@@ -471,39 +944,21 @@ utf8::string Resources::GetPathUtf8(const std::wstring& file)
 
 bool Resources::Download(const std::filesystem::path& path_to_file, const std::string& url, std::wstring& response)
 {
-    if (exists(path_to_file)) {
-        if (!std::filesystem::remove(path_to_file)) {
-            return StrSwprintf(response, L"Failed to delete existing file %s, err %d", path_to_file.wstring().c_str(), GetLastError()), false;
-        }
-    }
-    if (exists(path_to_file)) {
-        return StrSwprintf(response, L"File already exists @ %s", path_to_file.wstring().c_str()), false;
-    }
-
-    std::string content;
-    if (!Download(url, content)) {
-        return StrSwprintf(response, L"%S", content.c_str()), false;
-    }
-    if (!content.length()) {
-        return StrSwprintf(response, L"Failed to download %S, no content length", url.c_str()), false;
-    }
-    FILE* fp = fopen(path_to_file.string().c_str(), "wb");
-    if (!fp) {
-        return StrSwprintf(response, L"Failed to call fopen for %s, err %d", path_to_file.wstring().c_str(), GetLastError()), false;
-    }
-    const auto written = fwrite(content.data(), content.size() + 1, 1, fp);
-    fclose(fp);
-    if (written != 1) {
-        return StrSwprintf(response, L"Failed to call fwrite for %s, err %d", path_to_file.wstring().c_str(), GetLastError()), false;
+    AsyncRestClient r;
+    InitRestClient(&r);
+    r.SetUrl(url.c_str());
+    if (!r.SetDownloadFile(path_to_file)) {
+        return StrSwprintf(response, L"Failed to open %s for writing, err %d", path_to_file.wstring().c_str(), GetLastError()), false;
     }
-    return true;
+    r.ExecuteAsync();
+    r.Wait();
+    return ReadFileResponse(r, path_to_file, url, response);
 }
 
-void Resources::Download(const std::filesystem::path& path_to_file, const std::string& url, AsyncLoadCallback callback) const
+void Resources::Download(const std::filesystem::path& path_to_file, const std::string& url, AsyncLoadCallback callback, WorkerPriority priority) const
 {
-    EnqueueWorkerTask([this, path_to_file, url, callback] {
-        std::wstring error_message;
-        bool success = Download(path_to_file, url, error_message);
+    const auto key = std::string(reinterpret_cast<const char*>(path_to_file.u8string().c_str()));
+    const bool first = file_downloads.Join(key, [path_to_file, url, callback](const bool success, const std::wstring& error_message) {
         // and call the callback in the main thread
         if (callback) {
             EnqueueMainTask([callback, success, error_message] {
@@ -514,114 +969,70 @@ void Resources::Download(const std::filesystem::path& path_to_file, const std::s
             Log::LogW(L"Failed to download %s from %S\n%S", path_to_file.wstring().c_str(), url.c_str(), error_message.c_str());
         }
     });
+    if (!first) {
+        return;
+    }
+    const bool started = AsyncDownload::Start(url, [path_to_file, url, key](RestClient& r) {
+        std::wstring error_message;
+        const bool success = ReadFileResponse(r, path_to_file, url, error_message);
+        file_downloads.Finish(key, success, error_message);
+    }, priority, {}, path_to_file);
+    if (!started) {
+        std::wstring error_message;
+        StrSwprintf(error_message, L"Failed to open %s for writing, err %d", path_to_file.wstring().c_str(), GetLastError());
+        file_downloads.Finish(key, false, error_message);
+    }
 }
 
 bool Resources::Download(const std::string& url, std::string& response)
 {
-    RestClient r;
+    // Still goes through the curl thread so it can reuse a connection some other download already opened.
+    AsyncRestClient r;
     InitRestClient(&r);
     r.SetUrl(url.c_str());
-    r.Execute();
-    if (!r.IsSuccessful()) {
-        StrSprintf(response, "Failed to download %s, curl status %d %s", url.c_str(), r.GetStatusCode(), r.GetStatusStr());
-        return false;
-    }
-    response = std::move(r.GetContent());
-    return true;
+    r.ExecuteAsync();
+    r.Wait();
+    return ReadResponse(r, url, response);
 }
 
-void Resources::Download(const std::string& url, AsyncLoadMbCallback callback, void* context)
+void Resources::Download(const std::string& url, AsyncLoadMbCallback callback, void* context, WorkerPriority priority)
 {
-    EnqueueWorkerTask([url, callback, context] {
-        std::string response;
-        bool ok = Download(url, response);
+    const bool first = memory_downloads.Join(url, [callback, context](const bool ok, const std::string& response) {
         EnqueueMainTask([callback, ok, response, context] {
             callback(ok, response, context);
         });
     });
+    if (!first) {
+        return;
+    }
+    AsyncDownload::Start(url, [url](RestClient& r) {
+        std::string response;
+        const bool ok = ReadResponse(r, url, response);
+        memory_downloads.Finish(url, ok, response);
+    }, priority);
 }
 
 void Resources::Download(const std::string& url, AsyncLoadMbCallback callback, void* context, std::chrono::seconds cache_duration)
 {
-    const auto hash_name = [](const std::filesystem::path& file_name) -> std::filesystem::path {
-        const auto str = file_name.string();
-        const auto bytes_to_hash = std::vector<byte>(str.begin(), str.end());
-        auto hash = std::vector<byte>(WC_SHA256_DIGEST_SIZE);
-        wc_Sha256Hash(bytes_to_hash.data(), bytes_to_hash.size(), hash.data());
-        std::stringstream hexstream;
-        hexstream << std::hex << std::setfill('0');
-        for (auto b : hash) {
-            hexstream << std::setw(2) << static_cast<unsigned>(b);
-        }
-        const auto hash_str = hexstream.str();
-        const auto hash_file = std::filesystem::path(hash_str);
-        return hash_file;
-    };
-
-    const auto get_cache_modified_time = [](const std::filesystem::path& file_name) -> std::optional<std::filesystem::file_time_type> {
-        if (!std::filesystem::exists(file_name)) {
-            return std::optional<std::filesystem::file_time_type>();
-        }
-
-        const auto file_time = std::filesystem::last_write_time(file_name);
-        return file_time;
-    };
-
-    const auto load_from_cache = [](const std::filesystem::path& file_name) -> std::optional<std::string> {
-        std::ifstream cache_file(file_name);
-        if (!cache_file.is_open()) {
-            return {};
-        }
-
-        std::string contents((std::istreambuf_iterator<char>(cache_file)), std::istreambuf_iterator<char>());
-        return contents;
-    };
-
-    const auto save_to_cache = [](const std::filesystem::path& file_name, const std::string& content) -> bool {
-        std::filesystem::create_directories(file_name.parent_path());
-        std::ofstream cache_file(file_name);
-        if (!cache_file.is_open()) {
-            return false;
-        }
-
-        cache_file << content;
-        return true;
-    };
-
-    const auto remove_protocol = [](const std::string& url) -> std::string {
-        const std::string http = "http://";
-        const std::string https = "https://";
-
-        // Check if the URL starts with http:// or https:// and remove it
-        if (url.substr(0, http.size()) == http) {
-            return url.substr(http.size());
-        }
-        if (url.substr(0, https.size()) == https) {
-            return url.substr(https.size());
-        }
-        return url; // Return the original if no match is found
-    };
-
-    EnqueueWorkerTask([url, callback, context, &cache_duration, &get_cache_modified_time, &load_from_cache, &save_to_cache, &remove_protocol, &hash_name] {
-        const auto cache_path = Resources::GetPath("cache") / hash_name(remove_protocol(url));
-        const auto expiration = get_cache_modified_time(cache_path);
-        if (expiration.has_value() &&
-            expiration.value() - std::chrono::file_clock::now() < cache_duration) {
-            const auto response = load_from_cache(cache_path);
-            if (response.has_value()) {
-                EnqueueMainTask([callback, context, response] {
-                    callback(true, response.value(), context);
-                });
-                return;
-            }
-        }
-        std::string response;
-        bool ok = Download(url, response);
-        save_to_cache(cache_path, response);
+    const auto key = "cache:" + url;
+    const bool first = memory_downloads.Join(key, [callback, context](const bool ok, const std::string& response) {
         EnqueueMainTask([callback, ok, response, context] {
             callback(ok, response, context);
         });
     });
+    if (!first) {
+        return;
+    }
+    EnqueueWorkerTask([url, key, cache_duration] {
+        FetchCached(url, cache_duration, [key](const bool ok, const std::string& response) {
+            memory_downloads.Finish(key, ok, response);
+        });
+    });
+}
+
+size_t Resources::GetDeduplicatedDownloads()
+{
+    return deduplicated_downloads;
 }
 
 bool Resources::Post(const std::string& url, const std::string& payload, std::string& response)
@@ -656,7 +1067,7 @@ void Resources::Post(const std::string& url, const std::string& payload, AsyncLo
     });
 }
 
-void Resources::EnsureFileExists(const std::filesystem::path& path_to_file, const std::string& url, const AsyncLoadCallback& callback)
+void Resources::EnsureFileExists(const std::filesystem::path& path_to_file, const std::string& url, const AsyncLoadCallback& callback, WorkerPriority priority)
 {
     if (exists(path_to_file)) {
         // if file exists, run the callback immediately in the same thread
@@ -664,91 +1075,47 @@ void Resources::EnsureFileExists(const std::filesystem::path& path_to_file, cons
     }
     else {
         // otherwise try to download it in the worker
-        Instance().Download(path_to_file, url, callback);
+        Instance().Download(path_to_file, url, callback, priority);
     }
 }
 
-HRESULT Resources::TryCreateTexture(IDirect3DDevice9* device, const std::filesystem::path& path_to_file, IDirect3DTexture9** texture, std::wstring& error)
-{
-    // NB: Some Graphics cards seem to spit out D3DERR_NOTAVAILABLE when loading textures, haven't figured out why but retry if this error is reported
-    HRESULT res = D3DERR_NOTAVAILABLE;
-    size_t tries = 0;
-    const auto ext = path_to_file.extension();
-    while (res == D3DERR_NOTAVAILABLE && tries++ < 3) {
-        if (ext == ".dds") {
-            res = DirectX::CreateDDSTextureFromFileEx(device, path_to_file.c_str(), 0, D3DPOOL_MANAGED, true, texture);
-        }
-        else {
-            res = CreateWICTextureFromFileEx(device, path_to_file.c_str(), 0, 0, D3DPOOL_MANAGED, DirectX::WIC_LOADER_FLAGS::WIC_LOADER_DEFAULT, texture);
-        }
-    }
-    if (res != D3D_OK) {
-        StrSwprintf(error, L"Error loading resource from file %s - Error is %S", path_to_file.filename().wstring().c_str(), d3dErrorMessage(res));
-        return res;
-    }
-    if (!*texture) {
-        res = D3DERR_NOTFOUND;
-        StrSwprintf(error, L"Error loading resource from file %s - texture loaded is null", path_to_file.filename().wstring().c_str());
-    }
-    return res;
-}
-
-HRESULT Resources::TryCreateTexture(IDirect3DDevice9* pDevice, const HMODULE hSrcModule, const LPCSTR pSrcResource, IDirect3DTexture9** texture, std::wstring& error)
-{
-    // NB: Some Graphics cards seem to spit out D3DERR_NOTAVAILABLE when loading textures, haven't figured out why but retry if this error is reported
-    HRESULT res = D3DERR_NOTAVAILABLE;
-    size_t tries = 0;
-    while (res == D3DERR_NOTAVAILABLE && tries++ < 3) {
-        EmbeddedResource resource(pSrcResource, "RCDATA", hSrcModule);
-        if (!resource.data()) {
-            StrSwprintf(error, L"Error loading resource for id %p, module %p - texture not found", pSrcResource, hSrcModule);
-            return D3DERR_NOTFOUND;
-        }
-        res = CreateWICTextureFromMemoryEx(pDevice, static_cast<const uint8_t*>(resource.data()), resource.size(), 0, 0, D3DPOOL_MANAGED, DirectX::WIC_LOADER_DEFAULT, texture);
-        if (res != S_OK) {
-            res = DirectX::CreateDDSTextureFromMemoryEx(pDevice, static_cast<const uint8_t*>(resource.data()), resource.size(), 0, D3DPOOL_MANAGED, false, texture);
-        }
-    }
-    if (res != D3D_OK) {
-        StrSwprintf(error, L"Error loading resource for id %p, module %p - Error is %s", pSrcResource, hSrcModule, d3dErrorMessage(res));
-    }
-    else if (!*texture) {
-        res = D3DERR_NOTFOUND;
-        StrSwprintf(error, L"Error loading resource for id %p, module %p - texture loaded is null", pSrcResource, hSrcModule);
-    }
-    return res;
-}
-
 void Resources::LoadTexture(IDirect3DTexture9** texture, const std::filesystem::path& path_to_file, AsyncLoadCallback callback)
 {
-    EnqueueDxTask([path_to_file, texture, callback](IDirect3DDevice9* device) {
-        std::wstring error;
-        const HRESULT res = TryCreateTexture(device, path_to_file.c_str(), texture, error);
-        const bool success = res == D3D_OK;
-        if (callback) {
-            callback(success, error);
+    EnqueueWorkerTask([path_to_file, texture, callback] {
+        StagedTexture staged{texture, callback, L"file " + path_to_file.wstring()};
+        std::vector<uint8_t> bytes;
+        if (!ReadFileBytes(path_to_file, bytes)) {
+            StrSwprintf(staged.error, L"Error loading resource from file %s - failed to read file", path_to_file.filename().wstring().c_str());
         }
-        else if (!success) {
-            Log::LogW(L"Failed to load texture from file %s\n%s", path_to_file.wstring().c_str(), error.c_str());
+        else if (path_to_file.extension() == ".dds") {
+            staged.dds = std::move(bytes);
+            staged.dds_generate_mips = true;
+        }
+        else if (const HRESULT res = DecodeImage(bytes.data(), bytes.size(), staged); FAILED(res)) {
+            StrSwprintf(staged.error, L"Error loading resource from file %s - Error is %#08x", path_to_file.filename().wstring().c_str(), static_cast<unsigned>(res));
         }
+        StageTexture(std::move(staged));
     });
 }
 
 void Resources::LoadTexture(IDirect3DTexture9** texture, WORD id, AsyncLoadCallback callback)
 {
-    EnqueueDxTask([id, texture, callback](IDirect3DDevice9* device) {
-        std::wstring error{};
-        const bool success = TryCreateTexture(device, GWToolbox::GetDLLModule(), MAKEINTRESOURCE(id), texture, error) == D3D_OK;
-        if (callback) {
-            callback(success, error);
+    EnqueueWorkerTask([id, texture, callback] {
+        StagedTexture staged{texture, callback, std::format(L"resource id {}", id)};
+        const EmbeddedResource resource(MAKEINTRESOURCE(id), "RCDATA", GWToolbox::GetDLLModule());
+        if (!resource.data()) {
+            StrSwprintf(staged.error, L"Error loading resource for id %d - texture not found", id);
         }
-        else if (!success) {
-            Log::LogW(L"Failed to load texture from id %d\n%s", id, error.c_str());
+        else if (FAILED(DecodeImage(static_cast<const uint8_t*>(resource.data()), resource.size(), staged))) {
+            // Not something WIC can read; assume it's a dds
+            const auto data = static_cast<const uint8_t*>(resource.data());
+            staged.dds.assign(data, data + resource.size());
         }
+        StageTexture(std::move(staged));
     });
 }
 
-void Resources::LoadTexture(IDirect3DTexture9** texture, const std::filesystem::path& path_to_file, const std::string& url, AsyncLoadCallback callback)
+void Resources::LoadTexture(IDirect3DTexture9** texture, const std::filesystem::path& path_to_file, const std::string& url, AsyncLoadCallback callback, WorkerPriority priority)
 {
     EnsureFileExists(path_to_file, url, [texture, path_to_file, callback](const bool success, const std::wstring& error) {
         if (success) {
@@ -762,7 +1129,7 @@ void Resources::LoadTexture(IDirect3DTexture9** texture, const std::filesystem::
                 Log::LogW(L"Failed to EnsureFileExists %s\n%S", path_to_file.wstring().c_str(), error.c_str());
             }
         }
-    });
+    }, priority);
 }
 
 void Resources::LoadTexture(IDirect3DTexture9** texture, const std::filesystem::path& path_to_file, WORD id, AsyncLoadCallback callback)
@@ -839,17 +1206,62 @@ int Resources::SaveIniToFile(const std::filesystem::path& absolute_path, const T
 
 void Resources::DxUpdate(IDirect3DDevice9* device)
 {
+    const auto frame_start = std::chrono::steady_clock::now();
+    if (last_frame != std::chrono::steady_clock::time_point{}) {
+        frame_stats.frame_time[FrameTimeBucket(frame_start - last_frame)]++;
+    }
+    last_frame = frame_start;
+
     while (true) {
         dx_mutex.lock();
         if (dx_jobs.empty()) {
             dx_mutex.unlock();
-            return;
+            break;
         }
         const std::function<void(IDirect3DDevice9*)> func = std::move(dx_jobs.front());
         dx_jobs.pop();
         dx_mutex.unlock();
         func(device);
     }
+    UploadStagedTextures(device, frame_start);
+
+    frame_stats.dx_update_time[FrameTimeBucket(std::chrono::steady_clock::now() - frame_start)]++;
+}
+
+const Resources::FrameStats& Resources::GetFrameStats()
+{
+    return frame_stats;
+}
+
+void Resources::ResetFrameStats()
+{
+    frame_stats = {};
+}
+
+void Resources::RecordDrawCalls(const ImDrawData* draw_data)
+{
+    frame_stats.draw_calls = 0;
+    frame_stats.draw_calls_by_window.clear();
+    if (!draw_data) {
+        return;
+    }
+    for (int i = 0; i < draw_data->CmdListsCount; i++) {
+        const ImDrawList* draw_list = draw_data->CmdLists[i];
+        uint32_t count = 0;
+        for (const auto& cmd : draw_list->CmdBuffer) {
+            if (!cmd.UserCallback && cmd.ElemCount) {
+                count++;
+            }
+        }
+        frame_stats.draw_calls += count;
+        if (count) {
+            frame_stats.draw_calls_by_window.emplace_back(draw_list->_OwnerName ? draw_list->_OwnerName : "", count);
+        }
+    }
+    std::ranges::sort(frame_stats.draw_calls_by_window, std::greater{}, &std::pair<std::string, uint32_t>::second);
+    if (frame_stats.draw_calls_by_window.size() > 8) {
+        frame_stats.draw_calls_by_window.resize(8);
+    }
 }
 
 void Resources::Update(float)
@@ -881,10 +1293,13 @@ IDirect3DTexture9** Resources::GetProfessionIcon(GW::Constants::Profession p)
         swprintf(local_image, _countof(local_image), L"%s\\%d.png", path.c_str(), p);
         char remote_image[128];
         snprintf(remote_image, _countof(remote_image), "https://wiki.guildwars.com/images/%s.png", profession_icon_urls[prof_id]);
-        LoadTexture(texture, local_image, remote_image, [prof_id](const bool success, const std::wstring& error) {
+        LoadTexture(texture, local_image, remote_image, [prof_id, texture](const bool success, const std::wstring& error) {
             if (!success) {
                 Log::ErrorW(L"Failed to load icon for profession %d\n%s", prof_id, error.c_str());
             }
+            else {
+                AddToAtlas(texture);
+            }
         });
     }
     return texture;
@@ -953,6 +1368,7 @@ IDirect3DTexture9** Resources::GetGuildWarsWikiImage(const char* filename, size_
     // No local file found; download from wiki via skill link URL
     std::string wiki_url = "https://wiki.guildwars.com/wiki/File:";
     wiki_url.append(GuiUtils::UrlEncode(filename, '_'));
+    // Wiki images are requested by whatever is being drawn right now, so don't leave them behind bulk downloads.
     Instance().Download(wiki_url.c_str(), [texture, filename_sanitised, callback, width](const bool ok, const std::string& response, void*) {
         if (!ok) {
             callback(ok, GuiUtils::StringToWString(response));
@@ -984,8 +1400,8 @@ IDirect3DTexture9** Resources::GetGuildWarsWikiImage(const char* filename, size_
         if (strncmp(image_url.c_str(), "http", 4) != 0) {
             StrSprintf(image_url, "https://wiki.guildwars.com%s", image_url.c_str());
         }
-        LoadTexture(texture, path_to_file2, image_url, callback);
-    });
+        LoadTexture(texture, path_to_file2, image_url, callback, WorkerPriority::High);
+    }, nullptr, WorkerPriority::High);
     return texture;
 }
 
@@ -1001,16 +1417,17 @@ IDirect3DTexture9** Resources::GetSkillImageFromGWW(GW::Constants::SkillID skill
     if (skill_images.contains(skill_id)) {
         return skill_images.at(skill_id);
     }
-    const auto callback = [skill_id](const bool success, const std::wstring& error) {
+    const auto texture = new IDirect3DTexture9*;
+    *texture = nullptr;
+    const auto callback = [skill_id, texture](const bool success, const std::wstring& error) {
         if (!success) {
             Log::ErrorW(L"Failed to load skill image %d\n%s", skill_id, error.c_str());
         }
         else {
             Log::LogW(L"Loaded skill image %d", skill_id);
+            AddToAtlas(texture);
         }
     };
-    const auto texture = new IDirect3DTexture9*;
-    *texture = nullptr;
     skill_images[skill_id] = texture;
     if (skill_id == static_cast<GW::Constants::SkillID>(0)) {
         return texture;
@@ -1024,13 +1441,13 @@ IDirect3DTexture9** Resources::GetSkillImageFromGWW(GW::Constants::SkillID skill
     // Check for local jpg file
     swprintf(path_to_file, _countof(path_to_file), L"%s\\%d.jpg", path.wstring().c_str(), skill_id);
     if (std::filesystem::exists(path_to_file)) {
-        LoadTexture(texture, path_to_file, callback);
+        LoadTrackedTexture(texture, path_to_file, {}, callback);
         return texture;
     }
     // Check for local png file
     swprintf(path_to_file, _countof(path_to_file), L"%s\\%d.png", path.wstring().c_str(), skill_id);
     if (std::filesystem::exists(path_to_file)) {
-        LoadTexture(texture, path_to_file, callback);
+        LoadTrackedTexture(texture, path_to_file, {}, callback);
         return texture;
     }
     // No local file found; download from wiki via skill link URL
@@ -1084,7 +1501,7 @@ IDirect3DTexture9** Resources::GetSkillImageFromGWW(GW::Constants::SkillID skill
             // Image URL is relative to domain
             snprintf(url, _countof(url), "https://wiki.guildwars.com%s%s", image_path.c_str(), image_extension.c_str());
         }
-        LoadTexture(texture, path_to_file, url, callback);
+        LoadTrackedTexture(texture, path_to_file, url, callback);
     });
     return texture;
 }
@@ -1148,16 +1565,17 @@ IDirect3DTexture9** Resources::GetItemImage(const std::wstring& item_name)
     if (item_images.contains(item_name)) {
         return item_images.at(item_name);
     }
-    const auto callback = [item_name](const bool success, const std::wstring& error) {
+    const auto texture = new IDirect3DTexture9*;
+    *texture = nullptr;
+    const auto callback = [item_name, texture](const bool success, const std::wstring& error) {
         if (!success) {
             Log::ErrorW(L"Failed to load item image %s\n%s", item_name.c_str(), error.c_str());
         }
         else {
             Log::LogW(L"Loaded item image %s", item_name.c_str());
+            AddToAtlas(texture);
         }
     };
-    const auto texture = new IDirect3DTexture9*;
-    *texture = nullptr;
     item_images[item_name] = texture;
     static std::filesystem::path path = GetPath(ITEM_IMAGES_PATH);
     ASSERT(EnsureFolderExists(path));
@@ -1166,7 +1584,7 @@ IDirect3DTexture9** Resources::GetItemImage(const std::wstring& item_name)
     // Check for local png image
     swprintf(path_to_file, _countof(path_to_file), L"%s\\%s.png", path.c_str(), item_name.c_str());
     if (std::filesystem::exists(path_to_file)) {
-        LoadTexture(texture, path_to_file, callback);
+        LoadTrackedTexture(texture, path_to_file, {}, callback);
         return texture;
     }
 
@@ -1212,7 +1630,7 @@ IDirect3DTexture9** Resources::GetItemImage(const std::wstring& item_name)
             // Image URL is relative to domain
             snprintf(url, _countof(url), "https://wiki.guildwars.com%s%s", image_path.c_str(), image_extension.c_str());
         }
-        LoadTexture(texture, path_to_file, url, callback);
+        LoadTrackedTexture(texture, path_to_file, url, callback);
     });
     return texture;
 }
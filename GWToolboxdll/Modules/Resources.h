@@ -40,8 +40,41 @@ public:
     void Update(float delta) override;
     static void DxUpdate(IDirect3DDevice9* device);
 
+    // Worker tasks are run highest priority first, in the order they were queued within the same priority.
+    enum class WorkerPriority : uint8_t {
+        High, // Something the user is waiting on right now e.g. a file dialog, an image that's on screen
+        Normal,
+        Low, // Bulk work nobody is waiting for e.g. prefetching
+        Count
+    };
+    struct WorkerQueueStats {
+        size_t pending[static_cast<size_t>(WorkerPriority::Count)] = {}; // Tasks waiting per priority
+        size_t max_pending = 0; // Deepest the queue has been
+        size_t completed = 0; // Tasks that finished running
+        std::chrono::microseconds avg_wait{}; // Time between queueing a task and a worker picking it up
+        std::chrono::microseconds max_wait{};
+    };
+
     // Enqueue instruction to be called on worker thread, away from the render loop e.g. curl requests
-    static void EnqueueWorkerTask(const std::function<void()>& f);
+    static void EnqueueWorkerTask(const std::function<void()>& f, WorkerPriority priority = WorkerPriority::Normal);
+    static WorkerQueueStats GetWorkerQueueStats();
+
+    // Upper bound of each frame time bucket in microseconds; the last bucket catches everything slower.
+    static constexpr std::array<uint32_t, 10> frame_time_buckets = {1000, 2000, 4000, 8000, 12000, 16667, 25000, 33333, 50000, 100000};
+    struct FrameStats {
+        std::array<uint32_t, frame_time_buckets.size() + 1> frame_time{}; // Time between DxUpdate calls
+        std::array<uint32_t, frame_time_buckets.size() + 1> dx_update_time{}; // Time spent inside DxUpdate, texture uploads included
+        size_t textures_uploaded = 0;
+        size_t pending_uploads = 0; // Decoded textures waiting for a frame with budget left
+        std::chrono::microseconds max_upload{}; // Longest single texture upload
+        uint32_t draw_calls = 0; // Issued by ImGui last frame
+        std::vector<std::pair<std::string, uint32_t>> draw_calls_by_window; // Busiest windows first
+    };
+    static const FrameStats& GetFrameStats();
+    static void ResetFrameStats();
+    // Called once ImGui has rendered the frame
+    static void RecordDrawCalls(const ImDrawData* draw_data);
+
     // Enqueue instruction to be called on the main update loop of GW
     static void EnqueueMainTask(const std::function<void()>& f);
     // Enqueue instruction to be called on the draw loop of GW e.g. messing with DirectX9 device
@@ -77,6 +110,7 @@ public:
     // Callback for binary, usually only curl stuff; try to stick to wstrings where possible
     using AsyncLoadMbCallback = std::function<void(bool success, const std::string& response, void* context)>;
 
+    // Textures are read and decoded on a worker; DxUpdate uploads them a few per frame and runs the callback on the render thread.
     // Load from file to D3DTexture, runs callback on completion
     static void LoadTexture(IDirect3DTexture9** texture, const std::filesystem::path& path_to_file, AsyncLoadCallback callback = nullptr);
     // Load from compiled resource id to D3DTexture, runs callback on completion
@@ -84,7 +118,7 @@ public:
     // Load from file to D3DTexture, fallback to resource id, runs callback on completion
     static void LoadTexture(IDirect3DTexture9** texture, const std::filesystem::path& path_to_file, WORD id, AsyncLoadCallback callback = nullptr);
     // Load from file to D3DTexture, fallback to remote location, runs callback on completion
-    static void LoadTexture(IDirect3DTexture9** texture, const std::filesystem::path& path_to_file, const std::string& url, AsyncLoadCallback callback = nullptr);
+    static void LoadTexture(IDirect3DTexture9** texture, const std::filesystem::path& path_to_file, const std::string& url, AsyncLoadCallback callback = nullptr, WorkerPriority priority = WorkerPriority::Normal);
 
     // Guaranteed to return a pointer, but reference will be null until the texture has been loaded
     static IDirect3DTexture9** GetProfessionIcon(GW::Constants::Profession p);
@@ -113,18 +147,22 @@ public:
     static GuiUtils::EncString* DecodeStringId(const uint32_t enc_str_id, GW::Constants::Language language = (GW::Constants::Language)0xff);
 
     // Ensure file exists on disk, download from remote location if not found. If an error occurs, details are held in error string
-    static void EnsureFileExists(const std::filesystem::path& path_to_file, const std::string& url, const AsyncLoadCallback& callback);
+    static void EnsureFileExists(const std::filesystem::path& path_to_file, const std::string& url, const AsyncLoadCallback& callback, WorkerPriority priority = WorkerPriority::Normal);
 
     // download to file, blocking. If an error occurs, details are held in response string
     static bool Download(const std::filesystem::path& path_to_file, const std::string& url, std::wstring& response);
     // download to file, async, calls callback on completion. If an error occurs, details are held in response string
-    void Download(const std::filesystem::path& path_to_file, const std::string& url, AsyncLoadCallback callback) const;
+    void Download(const std::filesystem::path& path_to_file, const std::string& url, AsyncLoadCallback callback, WorkerPriority priority = WorkerPriority::Normal) const;
     // download to memory, blocking. If an error occurs, details are held in response string
     static bool Download(const std::string& url, std::string& response);
     // download to memory, async, calls callback on completion. If an error occurs, details are held in response string
-    static void Download(const std::string& url, AsyncLoadMbCallback callback, void* wparam = nullptr);
-    // download to memory, async, calls callback on completion and caches the response locally for the duration specified. If an error occurs, details are held in response string
+    static void Download(const std::string& url, AsyncLoadMbCallback callback, void* wparam = nullptr, WorkerPriority priority = WorkerPriority::Normal);
+    // download to memory, async, calls callback on completion. Responses are kept in the HttpCache and served from disk for the duration specified,
+    // then revalidated with the server. If an error occurs, details are held in response string
     static void Download(const std::string& url, AsyncLoadMbCallback callback, void* context, std::chrono::seconds cache_duration);
+    // Async downloads of a url (or to a file) that's already in flight share that transfer instead of starting another.
+    // Number of requests that did so since launch.
+    static size_t GetDeduplicatedDownloads();
 
     // download to memory, blocking. If an error occurs, details are held in response string
     static bool Post(const std::string& url, const std::string& payload, std::string& response);
@@ -136,10 +174,6 @@ public:
 
 private:
     static void Cleanup();
-    // Assign IDirect3DTexture9* from file
-    static HRESULT TryCreateTexture(IDirect3DDevice9* device, const std::filesystem::path& path_to_file, IDirect3DTexture9** texture, std::wstring& error);
-    // Assign IDirect3DTexture9* from resource
-    static HRESULT TryCreateTexture(IDirect3DDevice9* pDevice, HMODULE hSrcModule, LPCSTR pSrcResource, IDirect3DTexture9** texture, std::wstring& error);
     // Copy from compiled resource binary to file on local disk.
     static bool ResourceToFile(WORD id, const std::filesystem::path& path_to_file, std::wstring& error);
 };
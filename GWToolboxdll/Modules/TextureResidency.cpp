@@ -0,0 +1,278 @@
+#include "stdafx.h"
+
+#include <ImGuiAddons.h>
+
+#include <Modules/TextureResidency.h>
+#include <Utils/TextureAtlas.h>
+
+namespace {
+    // Textures drawn within this long are never evicted, however far over budget we are
+    constexpr auto min_idle = std::chrono::seconds(30);
+    // Sizes are accounted and evictions made at most this often
+    constexpr auto sweep_interval = std::chrono::seconds(1);
+
+    struct Entry {
+        IDirect3DTexture9** slot = nullptr;
+        std::function<void()> reload;
+        IDirect3DTexture9* resident = nullptr; // What *slot held at the last sweep, if it was a real texture
+        IDirect3DTexture9* placeholder = nullptr; // Stands in for the texture while it's evicted
+        uint64_t bytes = 0;
+        std::chrono::steady_clock::time_point last_drawn;
+        bool reloading = false;
+    };
+
+    std::mutex residency_mutex;
+    // By slot; node based, so Entry pointers stay valid until erased
+    std::unordered_map<IDirect3DTexture9**, Entry> entries;
+    // Resident textures and placeholders, for MarkDrawn
+    std::unordered_map<ImTextureID, Entry*> entries_by_texture;
+    std::vector<Entry*> pending_reloads;
+    std::chrono::steady_clock::time_point last_sweep;
+    TextureResidency::Stats stats;
+    int budget_mb = 64;
+
+    uint64_t TextureBytes(IDirect3DTexture9* texture)
+    {
+        uint64_t bytes = 0;
+        for (DWORD level = 0; level < texture->GetLevelCount(); level++) {
+            D3DSURFACE_DESC desc;
+            if (texture->GetLevelDesc(level, &desc) != D3D_OK) {
+                break;
+            }
+            const uint64_t pixels = static_cast<uint64_t>(desc.Width) * desc.Height;
+            switch (desc.Format) {
+                case D3DFMT_DXT1:
+                    bytes += pixels / 2;
+                    break;
+                case D3DFMT_DXT2:
+                case D3DFMT_DXT3:
+                case D3DFMT_DXT4:
+                case D3DFMT_DXT5:
+                case D3DFMT_L8:
+                case D3DFMT_A8:
+                    bytes += pixels;
+                    break;
+                case D3DFMT_R5G6B5:
+                case D3DFMT_A1R5G5B5:
+                case D3DFMT_A4R4G4B4:
+                    bytes += pixels * 2;
+                    break;
+                default:
+                    bytes += pixels * 4;
+                    break;
+            }
+        }
+        return bytes;
+    }
+
+    // Caller holds residency_mutex
+    void MarkDrawnLocked(const ImTextureID texture, const std::chrono::steady_clock::time_point now)
+    {
+        const auto found = entries_by_texture.find(texture);
+        if (found == entries_by_texture.end()) {
+            return;
+        }
+        const auto entry = found->second;
+        entry->last_drawn = now;
+        if (texture == entry->placeholder && !entry->reloading && entry->reload) {
+            entry->reloading = true;
+            pending_reloads.push_back(entry);
+        }
+    }
+
+    IDirect3DTexture9* CreatePlaceholder(IDirect3DDevice9* device)
+    {
+        IDirect3DTexture9* texture = nullptr;
+        if (device->CreateTexture(1, 1, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &texture, nullptr) != D3D_OK) {
+            return nullptr;
+        }
+        D3DLOCKED_RECT rect;
+        if (texture->LockRect(0, &rect, nullptr, 0) == D3D_OK) {
+            *static_cast<uint32_t*>(rect.pBits) = 0; // Fully transparent
+            texture->UnlockRect(0);
+        }
+        return texture;
+    }
+
+    bool Evict(IDirect3DDevice9* device, Entry& entry)
+    {
+        const auto placeholder = CreatePlaceholder(device);
+        if (!placeholder) {
+            return false;
+        }
+        entries_by_texture.erase(entry.resident);
+        TextureAtlas::Remove(entry.resident);
+        *entry.slot = placeholder;
+        entry.resident->Release();
+        entry.resident = nullptr;
+        entry.bytes = 0;
+        entry.placeholder = placeholder;
+        entries_by_texture[placeholder] = &entry;
+        stats.evictions++;
+        return true;
+    }
+
+    // Pick up textures that finished loading since the last sweep, then evict the least recently drawn until back under budget
+    void Sweep(IDirect3DDevice9* device, const std::chrono::steady_clock::time_point now)
+    {
+        stats.resident_bytes = 0;
+        stats.resident = 0;
+        stats.evicted = 0;
+        std::vector<Entry*> idle;
+        for (auto& entry : entries | std::views::values) {
+            IDirect3DTexture9* current = *entry.slot;
+            if (current && current != entry.placeholder && current != entry.resident) {
+                if (entry.resident) {
+                    entries_by_texture.erase(entry.resident);
+                }
+                if (entry.placeholder) {
+                    entries_by_texture.erase(entry.placeholder);
+                    entry.placeholder->Release();
+                    entry.placeholder = nullptr;
+                }
+                entry.resident = current;
+                entry.bytes = TextureBytes(current);
+                entry.reloading = false;
+                entry.last_drawn = now; // Someone just asked for it
+                entries_by_texture[current] = &entry;
+            }
+            if (entry.resident) {
+                stats.resident++;
+                stats.resident_bytes += entry.bytes;
+                if (now - entry.last_drawn >= min_idle) {
+                    idle.push_back(&entry);
+                }
+            }
+            else if (entry.placeholder) {
+                stats.evicted++;
+            }
+        }
+        stats.tracked = entries.size();
+        stats.budget_bytes = static_cast<uint64_t>(budget_mb) * 1024 * 1024;
+        if (stats.resident_bytes <= stats.budget_bytes) {
+            return;
+        }
+        std::ranges::sort(idle, {}, &Entry::last_drawn);
+        for (const auto entry : idle) {
+            if (stats.resident_bytes <= stats.budget_bytes) {
+                break;
+            }
+            const auto bytes = entry->bytes;
+            if (!Evict(device, *entry)) {
+                break;
+            }
+            stats.resident_bytes -= bytes;
+            stats.resident--;
+            stats.evicted++;
+        }
+    }
+}
+
+void TextureResidency::Terminate()
+{
+    ToolboxModule::Terminate();
+    std::lock_guard lock(residency_mutex);
+    for (const auto& entry : entries | std::views::values) {
+        if (entry.placeholder) {
+            if (*entry.slot == entry.placeholder) {
+                *entry.slot = nullptr;
+            }
+            entry.placeholder->Release();
+        }
+    }
+    entries.clear();
+    entries_by_texture.clear();
+    pending_reloads.clear();
+    stats = {};
+}
+
+void TextureResidency::LoadSettings(ToolboxIni* ini)
+{
+    ToolboxModule::LoadSettings(ini);
+    budget_mb = std::max(static_cast<int>(ini->GetLongValue(Name(), "budget_mb", budget_mb)), 1);
+}
+
+void TextureResidency::SaveSettings(ToolboxIni* ini)
+{
+    ToolboxModule::SaveSettings(ini);
+    ini->SetLongValue(Name(), "budget_mb", budget_mb);
+}
+
+void TextureResidency::DrawSettingsInternal()
+{
+    ImGui::Text("Texture memory:");
+    ImGui::ShowHelp("Skill, item and other images Toolbox has loaded.\n"
+                    "Once they take up more than the budget, the ones that haven't been on screen for a while are unloaded, and loaded again next time they're shown.");
+    int mb = budget_mb;
+    if (ImGui::InputInt("Budget (MB)", &mb, 8, 64)) {
+        budget_mb = std::max(mb, 1);
+    }
+    const auto current = GetStats();
+    ImGui::Text("%zu textures tracked, %zu loaded (%.1f MB), %zu unloaded", current.tracked, current.resident,
+                static_cast<double>(current.resident_bytes) / (1024 * 1024), current.evicted);
+    ImGui::Text("%zu unloaded to stay under budget, %zu loaded again", current.evictions, current.reloads);
+}
+
+void TextureResidency::Track(IDirect3DTexture9** slot, std::function<void()> reload)
+{
+    if (!slot) {
+        return;
+    }
+    std::lock_guard lock(residency_mutex);
+    auto& entry = entries[slot];
+    entry.slot = slot;
+    entry.reload = std::move(reload);
+    entry.last_drawn = std::chrono::steady_clock::now();
+}
+
+void TextureResidency::MarkDrawn(const ImTextureID texture)
+{
+    if (!texture) {
+        return;
+    }
+    std::lock_guard lock(residency_mutex);
+    MarkDrawnLocked(texture, std::chrono::steady_clock::now());
+}
+
+void TextureResidency::MarkDrawn(const ImDrawData* draw_data)
+{
+    if (!draw_data) {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard lock(residency_mutex);
+    for (int i = 0; i < draw_data->CmdListsCount; i++) {
+        for (const auto& cmd : draw_data->CmdLists[i]->CmdBuffer) {
+            MarkDrawnLocked(cmd.TextureId, now);
+        }
+    }
+}
+
+void TextureResidency::DxUpdate(IDirect3DDevice9* device)
+{
+    std::vector<std::function<void()>> reloads;
+    {
+        std::lock_guard lock(residency_mutex);
+        for (const auto entry : pending_reloads) {
+            reloads.push_back(entry->reload);
+        }
+        stats.reloads += pending_reloads.size();
+        pending_reloads.clear();
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - last_sweep >= sweep_interval) {
+            last_sweep = now;
+            Sweep(device, now);
+        }
+    }
+    // Reloads queue work on Resources; don't hold the lock while they do
+    for (const auto& reload : reloads) {
+        reload();
+    }
+}
+
+TextureResidency::Stats TextureResidency::GetStats()
+{
+    std::lock_guard lock(residency_mutex);
+    return stats;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <ToolboxModule.h>
+
+// Keeps the textures Resources and GwDatTextureModule hand out (skill, item and dat images) under a memory budget.
+// The ones drawn least recently are released; their slot gets a tiny transparent placeholder, and drawing that
+// placeholder loads the real texture back in, so callers holding on to the slot never notice.
+class TextureResidency : public ToolboxModule {
+    TextureResidency() = default;
+    ~TextureResidency() override = default;
+
+public:
+    static TextureResidency& Instance()
+    {
+        static TextureResidency instance;
+        return instance;
+    }
+
+    [[nodiscard]] const char* Name() const override { return "Texture Residency"; }
+    // DrawSettingInternal() called via ToolboxSettings; don't draw it again
+    bool HasSettings() override { return false; }
+
+    void Terminate() override;
+    void LoadSettings(ToolboxIni* ini) override;
+    void SaveSettings(ToolboxIni* ini) override;
+    void DrawSettingsInternal() override;
+
+    struct Stats {
+        size_t tracked = 0;
+        size_t resident = 0;
+        size_t evicted = 0; // Currently evicted, waiting to be drawn again
+        size_t evictions = 0;
+        size_t reloads = 0;
+        uint64_t resident_bytes = 0;
+        uint64_t budget_bytes = 0;
+    };
+
+    // Start tracking a texture slot; reload refills *slot after it's been evicted. Thread-safe; tracking a slot again replaces its reload.
+    static void Track(IDirect3DTexture9** slot, std::function<void()> reload);
+    // Texture is on screen this frame. Keeps it resident, or brings it back if it's an evicted texture's placeholder.
+    static void MarkDrawn(ImTextureID texture);
+    // Marks every texture ImGui is about to draw; called once ImGui has rendered the frame
+    static void MarkDrawn(const ImDrawData* draw_data);
+    // Render thread; runs pending reloads, accounts for new textures and evicts once over budget
+    static void DxUpdate(IDirect3DDevice9* device);
+
+    static Stats GetStats();
+};
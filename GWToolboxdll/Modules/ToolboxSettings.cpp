@@ -10,6 +10,8 @@
 
 #include <Modules/Updater.h>
 #include <Modules/Resources.h>
+#include <Modules/HttpCache.h>
+#include <Modules/TextureResidency.h>
 #include <Modules/ChatFilter.h>
 #include <Modules/ItemFilter.h>
 #include <Modules/DiscordModule.h>
@@ -239,6 +241,12 @@ void ToolboxSettings::DrawSettingsInternal()
     Updater::Instance().DrawSettingsInternal();
     ImGui::Separator();
 
+    HttpCache::Instance().DrawSettingsInternal();
+    ImGui::Separator();
+
+    TextureResidency::Instance().DrawSettingsInternal();
+    ImGui::Separator();
+
     ImGui::Checkbox("Save Location Data", &save_location_data);
     ImGui::ShowHelp("Toolbox will save your location every second in a file in Settings Folder.");
     const auto cols = static_cast<size_t>(floor(ImGui::GetWindowWidth() / (170.0f * ImGui::GetIO().FontGlobalScale)));
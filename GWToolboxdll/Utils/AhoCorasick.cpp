@@ -0,0 +1,115 @@
+#include "stdafx.h"
+
+#include "AhoCorasick.h"
+
+void AhoCorasick::Clear()
+{
+    nodes.clear();
+    edges.clear();
+    root_edges.fill(0);
+    pattern_count = 0;
+}
+
+void AhoCorasick::Build(const std::vector<std::wstring>& patterns)
+{
+    Clear();
+
+    // Plain trie first; children are kept sorted so they can be flattened straight into edges
+    std::vector<std::map<wchar_t, uint32_t>> children(1);
+    nodes.resize(1);
+    for (size_t i = 0; i < patterns.size(); i++) {
+        if (patterns[i].empty()) {
+            continue;
+        }
+        uint32_t state = 0;
+        for (const auto c : patterns[i]) {
+            const auto found = children[state].find(c);
+            if (found != children[state].end()) {
+                state = found->second;
+                continue;
+            }
+            const auto next = static_cast<uint32_t>(nodes.size());
+            children[state][c] = next;
+            children.emplace_back();
+            nodes.emplace_back();
+            state = next;
+        }
+        if (nodes[state].pattern == npos) {
+            nodes[state].pattern = static_cast<uint32_t>(i);
+        }
+        pattern_count++;
+    }
+
+    // Fail links, breadth first so every node's fail target is finished before the node itself
+    std::queue<uint32_t> queue;
+    for (const auto child : children[0] | std::views::values) {
+        queue.push(child);
+    }
+    while (!queue.empty()) {
+        const auto parent = queue.front();
+        queue.pop();
+        auto& node = nodes[parent];
+        const auto& fail = nodes[node.fail];
+        node.output_link = fail.pattern != npos ? node.fail : fail.output_link;
+        node.terminal = node.pattern != npos || fail.terminal;
+        for (const auto& [c, child] : children[parent]) {
+            auto f = node.fail;
+            auto found = children[f].find(c);
+            while (found == children[f].end() && f != 0) {
+                f = nodes[f].fail;
+                found = children[f].find(c);
+            }
+            nodes[child].fail = found != children[f].end() ? found->second : 0;
+            queue.push(child);
+        }
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        nodes[i].edges_begin = static_cast<uint32_t>(edges.size());
+        for (const auto& [c, child] : children[i]) {
+            edges.push_back({c, child});
+        }
+        nodes[i].edges_end = static_cast<uint32_t>(edges.size());
+    }
+    for (const auto& [c, child] : children[0]) {
+        if (static_cast<size_t>(c) < root_edges.size()) {
+            root_edges[c] = child;
+        }
+    }
+}
+
+uint32_t AhoCorasick::Next(uint32_t state, const wchar_t c) const
+{
+    while (true) {
+        if (state == 0 && static_cast<size_t>(c) < root_edges.size()) {
+            return root_edges[c];
+        }
+        const auto begin = edges.begin() + nodes[state].edges_begin;
+        const auto end = edges.begin() + nodes[state].edges_end;
+        const auto found = std::lower_bound(begin, end, c, [](const Edge& edge, const wchar_t value) {
+            return edge.c < value;
+        });
+        if (found != end && found->c == c) {
+            return found->to;
+        }
+        if (state == 0) {
+            return 0;
+        }
+        state = nodes[state].fail;
+    }
+}
+
+bool AhoCorasick::Contains(const std::wstring_view text) const
+{
+    if (empty()) {
+        return false;
+    }
+    uint32_t state = 0;
+    for (const auto c : text) {
+        state = Next(state, c);
+        if (nodes[state].terminal) {
+            return true;
+        }
+    }
+    return false;
+}
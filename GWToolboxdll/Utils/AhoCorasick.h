@@ -0,0 +1,59 @@
+#pragma once
+
+// Finds any number of fixed strings in one pass over the text, however many there are.
+// Patterns are matched exactly, character for character; fold case or diacritics on both sides beforehand if that's wanted.
+// Build once, then search from any thread.
+class AhoCorasick {
+public:
+    static constexpr uint32_t npos = 0xffffffff;
+
+    // Replaces any previous patterns. Empty patterns are skipped; duplicates report the index of the first.
+    void Build(const std::vector<std::wstring>& patterns);
+    void Clear();
+    [[nodiscard]] bool empty() const { return pattern_count == 0; }
+
+    // True if any pattern occurs in text
+    [[nodiscard]] bool Contains(std::wstring_view text) const;
+
+    // Calls on_match(pattern_index, end) for every occurrence, end being one past its last character in text.
+    // Occurrences are reported in order of where they end; longer patterns first for the same end.
+    // Return false from on_match to stop searching.
+    template <typename Fn>
+    void ForEachMatch(const std::wstring_view text, Fn&& on_match) const
+    {
+        if (empty()) {
+            return;
+        }
+        uint32_t state = 0;
+        for (size_t i = 0; i < text.size(); i++) {
+            state = Next(state, text[i]);
+            for (auto out = nodes[state].pattern != npos ? state : nodes[state].output_link; out != npos; out = nodes[out].output_link) {
+                if (!on_match(nodes[out].pattern, i + 1)) {
+                    return;
+                }
+            }
+        }
+    }
+
+private:
+    struct Node {
+        uint32_t edges_begin = 0; // Into edges, sorted by character
+        uint32_t edges_end = 0;
+        uint32_t fail = 0; // Longest proper suffix of this node's string that's also in the trie
+        uint32_t output_link = npos; // Nearest node down the fail chain that ends a pattern
+        uint32_t pattern = npos; // Pattern ending exactly here
+        bool terminal = false; // A pattern ends here or somewhere down the fail chain
+    };
+    struct Edge {
+        wchar_t c;
+        uint32_t to;
+    };
+
+    [[nodiscard]] uint32_t Next(uint32_t state, wchar_t c) const;
+
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+    // Transitions out of the root for the Latin-1 range, which covers most chat, without searching its edges
+    std::array<uint32_t, 0x100> root_edges{};
+    size_t pattern_count = 0;
+};
@@ -6,6 +6,8 @@
 #include <GWCA/Managers/MemoryMgr.h>
 #include <GWCA/Managers/GameThreadMgr.h>
 
+#include <emmintrin.h>
+
 #include <Utf8.h>
 #include <fonts/fontawesome5.h>
 #include <Modules/Resources.h>
@@ -108,7 +110,119 @@ namespace {
         L"z\u007A\u24E9\uFF5A\u017A\u1E91\u017C\u017E\u1E93\u1E95\u01B6\u0225\u0240\u2C6C\uA763"
     };
 
-    std::map<wchar_t, wchar_t> diacritics_charmap;
+    // Every UTF-16 code unit mapped to itself with its diacritics stripped, built from diacritics[] on first use
+    const std::array<wchar_t, 0x10000>& DiacriticsTable()
+    {
+        static const auto table = [] {
+            std::array<wchar_t, 0x10000> out{};
+            for (size_t i = 0; i < out.size(); i++) {
+                out[i] = static_cast<wchar_t>(i);
+            }
+            for (const auto mapping : diacritics) {
+                for (size_t j = 1; mapping[j]; j++) {
+                    if (mapping[j] >= 0x7f) {
+                        out[mapping[j]] = mapping[0];
+                    }
+                }
+            }
+            return out;
+        }();
+        return table;
+    }
+
+    wchar_t AsciiToLower(const wchar_t c)
+    {
+        return c >= L'A' && c <= L'Z' ? static_cast<wchar_t>(c + (L'a' - L'A')) : c;
+    }
+
+    char AsciiToLower(const char c)
+    {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+
+    bool IsPunct(const wchar_t c)
+    {
+        return c < 0x80 && ispunct(c);
+    }
+
+    // SSE2 helpers for runs of plain ASCII, which is most of what passes through here.
+    // Each works on 8 wide (or 16 narrow) characters at a time; callers finish off the tail one by one.
+
+    // True if all 8 wide chars at s are below 0x80
+    bool IsAscii8(const wchar_t* s)
+    {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        return _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xff80))), _mm_setzero_si128())) == 0xffff;
+    }
+
+    // Lower case 8 ASCII wide chars from in to out
+    void ToLowerAscii8(const wchar_t* in, wchar_t* out)
+    {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        const auto upper = _mm_and_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16('A' - 1)), _mm_cmplt_epi16(v, _mm_set1_epi16('Z' + 1)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_add_epi16(v, _mm_and_si128(upper, _mm_set1_epi16('a' - 'A'))));
+    }
+
+    // Lower case 16 narrow chars from in to out; bytes outside A-Z (including anything >= 0x80) are left alone
+    void ToLowerAscii16(const char* in, char* out)
+    {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        const auto upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A'))));
+    }
+
+    // Narrow 8 ASCII wide chars from in to out
+    void NarrowAscii8(const wchar_t* in, char* out)
+    {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(v, v));
+    }
+
+    // True if all 16 narrow chars at s are below 0x80
+    bool IsAscii16(const char* s)
+    {
+        return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s))) == 0;
+    }
+
+    // Widen 16 ASCII narrow chars from in to out
+    void WidenAscii16(const char* in, wchar_t* out)
+    {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+    }
+
+    bool IsAscii(const std::wstring_view str)
+    {
+        size_t i = 0;
+        for (; i + 8 <= str.size(); i += 8) {
+            if (!IsAscii8(str.data() + i)) {
+                return false;
+            }
+        }
+        for (; i < str.size(); i++) {
+            if (str[i] >= 0x80) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool IsAscii(const std::string_view str)
+    {
+        size_t i = 0;
+        for (; i + 16 <= str.size(); i += 16) {
+            if (!IsAscii16(str.data() + i)) {
+                return false;
+            }
+        }
+        for (; i < str.size(); i++) {
+            if (static_cast<unsigned char>(str[i]) >= 0x80) {
+                return false;
+            }
+        }
+        return true;
+    }
 }
 
 namespace GuiUtils {
@@ -411,20 +525,51 @@ namespace GuiUtils {
 
     std::string ToLower(std::string s)
     {
-        std::ranges::transform(s, s.begin(), [](const char c) -> char {
-            return static_cast<char>(tolower(c));
-        });
+        ToLowerInPlace(s);
         return s;
     }
 
     std::wstring ToLower(std::wstring s)
     {
-        std::ranges::transform(s, s.begin(), [](const wchar_t c) -> wchar_t {
-            return static_cast<wchar_t>(tolower(c));
-        });
+        ToLowerInPlace(s);
         return s;
     }
 
+    void ToLower(const std::wstring_view in, std::wstring& out)
+    {
+        out.resize(in.size());
+        size_t i = 0;
+        for (; i + 8 <= in.size(); i += 8) {
+            // Non-ASCII chars are outside A-Z anyway, so every block can go through the SIMD path
+            ToLowerAscii8(in.data() + i, out.data() + i);
+        }
+        for (; i < in.size(); i++) {
+            out[i] = AsciiToLower(in[i]);
+        }
+    }
+
+    void ToLowerInPlace(const std::span<wchar_t> s)
+    {
+        size_t i = 0;
+        for (; i + 8 <= s.size(); i += 8) {
+            ToLowerAscii8(s.data() + i, s.data() + i);
+        }
+        for (; i < s.size(); i++) {
+            s[i] = AsciiToLower(s[i]);
+        }
+    }
+
+    void ToLowerInPlace(const std::span<char> s)
+    {
+        size_t i = 0;
+        for (; i + 16 <= s.size(); i += 16) {
+            ToLowerAscii16(s.data() + i, s.data() + i);
+        }
+        for (; i < s.size(); i++) {
+            s[i] = AsciiToLower(s[i]);
+        }
+    }
+
     std::string HtmlEncode(const std::string& s)
     {
         if (s.empty()) {
@@ -506,10 +651,30 @@ namespace GuiUtils {
 
     // Convert a wide Unicode string to an UTF8 string
     std::string WStringToString(const std::wstring_view str)
+    {
+        std::string dest;
+        WStringToString(str, dest);
+        return dest;
+    }
+
+    void WStringToString(const std::wstring_view str, std::string& out)
     {
         // @Cleanup: ASSERT used incorrectly here; value passed could be from anywhere!
+        out.clear();
         if (str.empty()) {
-            return "";
+            return;
+        }
+        if (IsAscii(str)) {
+            // Same bytes in UTF-8 and any ANSI code page
+            out.resize(str.size());
+            size_t i = 0;
+            for (; i + 8 <= str.size(); i += 8) {
+                NarrowAscii8(str.data() + i, out.data() + i);
+            }
+            for (; i < str.size(); i++) {
+                out[i] = static_cast<char>(str[i]);
+            }
+            return;
         }
         // NB: GW uses code page 0 (CP_ACP)
         const int try_code_pages[] = { CP_UTF8, CP_ACP };
@@ -517,12 +682,11 @@ namespace GuiUtils {
             const auto size_needed = WideCharToMultiByte(cp, WC_ERR_INVALID_CHARS, str.data(), static_cast<int>(str.size()), nullptr, 0, nullptr, nullptr);
             if (!size_needed)
                 continue;
-            std::string dest(size_needed, 0);
-            ASSERT(WideCharToMultiByte(cp, 0, str.data(), static_cast<int>(str.size()), dest.data(), size_needed, nullptr, nullptr));
-            return dest;
+            out.resize(size_needed);
+            ASSERT(WideCharToMultiByte(cp, 0, str.data(), static_cast<int>(str.size()), out.data(), size_needed, nullptr, nullptr));
+            return;
         }
         ASSERT("Failed to convert" && false);
-        return {};
     }
 
     // Makes sure the file name doesn't have chars that won't be allowed on disk
@@ -563,31 +727,59 @@ namespace GuiUtils {
 
     std::wstring RemoveDiacritics(const std::wstring& s)
     {
-        if (diacritics_charmap.empty()) {
-            // Build static diacritics map if not already done so
-            for (size_t i = 0; i < _countof(diacritics); i++) {
-                for (size_t j = 1; diacritics[i][j]; j++) {
-                    diacritics_charmap[diacritics[i][j]] = diacritics[i][0];
-                }
+        std::wstring out;
+        RemoveDiacritics(s, out);
+        return out;
+    }
+
+    void RemoveDiacritics(const std::wstring_view in, std::wstring& out)
+    {
+        out.assign(in);
+        RemoveDiacriticsInPlace(out);
+    }
+
+    void RemoveDiacriticsInPlace(const std::span<wchar_t> s)
+    {
+        const auto& table = DiacriticsTable();
+        size_t i = 0;
+        for (; i + 8 <= s.size(); i += 8) {
+            if (IsAscii8(s.data() + i)) {
+                continue; // No diacritics below 0x80
             }
-        }
-        std::wstring out(s.length(), L'\0');
-        std::ranges::transform(s, out.begin(), [&](const wchar_t wc) -> wchar_t {
-            if (wc < 0x7f) {
-                return wc;
+            for (size_t j = i; j < i + 8; j++) {
+                s[j] = table[static_cast<uint16_t>(s[j])];
             }
-            const auto it = diacritics_charmap.find(wc);
-            return it == diacritics_charmap.end() ? wc : it->second;
-        });
-        return out;
+        }
+        for (; i < s.size(); i++) {
+            s[i] = table[static_cast<uint16_t>(s[i])];
+        }
     }
 
     // Convert an UTF8 string to a wide Unicode String
     std::wstring StringToWString(const std::string_view str)
+    {
+        std::wstring dest;
+        StringToWString(str, dest);
+        return dest;
+    }
+
+    void StringToWString(const std::string_view str, std::wstring& out)
     {
         // @Cleanup: ASSERT used incorrectly here; value passed could be from anywhere!
+        out.clear();
         if (str.empty()) {
-            return {};
+            return;
+        }
+        if (IsAscii(str)) {
+            out.resize(str.size());
+            size_t i = 0;
+            for (; i + 16 <= str.size(); i += 16) {
+                WidenAscii16(str.data() + i, out.data() + i);
+            }
+            for (; i < str.size(); i++) {
+                out[i] = static_cast<wchar_t>(str[i]);
+            }
+            return;
         }
         // NB: GW uses code page 0 (CP_ACP)
         const int try_code_pages[] = { CP_UTF8, CP_ACP };
@@ -595,20 +787,25 @@ namespace GuiUtils {
             const auto size_needed = MultiByteToWideChar(cp, MB_ERR_INVALID_CHARS, str.data(), static_cast<int>(str.size()), nullptr, 0);
             if (!size_needed)
                 continue;
-            std::wstring dest(size_needed, 0);
-            ASSERT(MultiByteToWideChar(cp, 0, str.data(), static_cast<int>(str.size()), dest.data(), size_needed));
-            return dest;
+            out.resize(size_needed);
+            ASSERT(MultiByteToWideChar(cp, 0, str.data(), static_cast<int>(str.size()), out.data(), size_needed));
+            return;
         }
         ASSERT("Failed to convert" && false);
-        return {};
     }
 
     std::wstring SanitizePlayerName(const std::wstring_view str)
+    {
+        std::wstring out;
+        SanitizePlayerName(str, out);
+        return out;
+    }
+
+    void SanitizePlayerName(const std::wstring_view str, std::wstring& out)
     {
         // e.g. "Player Name (2)" => "Player Name", for pvp player names
         // e.g. "Player Name [TAG]" = >"Player Name", for alliance message sender name
-        wchar_t out[64]{};
-        size_t len = 0;
+        out.clear();
         wchar_t remove_char_token = 0;
         for (const auto& wchar : str) {
             if (remove_char_token) {
@@ -619,22 +816,20 @@ namespace GuiUtils {
             }
             if (wchar == '[') {
                 remove_char_token = ']';
-                if (len > 0) {
-                    len--;
+                if (!out.empty()) {
+                    out.pop_back();
                 }
                 continue;
             }
             if (wchar == '(') {
                 remove_char_token = ')';
-                if (len > 0) {
-                    len--;
+                if (!out.empty()) {
+                    out.pop_back();
                 }
                 continue;
             }
-            out[len++] = wchar;
+            out.push_back(wchar);
         }
-        out[len] = 0;
-        return {out};
     }
 
     std::wstring GetPlayerNameFromEncodedString(const wchar_t* message, const wchar_t** start_pos_out, const wchar_t** end_pos_out)
@@ -666,10 +861,15 @@ namespace GuiUtils {
 
     std::wstring RemovePunctuation(std::wstring s)
     {
-        std::erase_if(s, &ispunct);
+        RemovePunctuationInPlace(s);
         return s;
     }
 
+    void RemovePunctuationInPlace(std::wstring& s)
+    {
+        std::erase_if(s, &IsPunct);
+    }
+
     bool ParseInt(const char* str, int* val, const int base)
     {
         char* end;
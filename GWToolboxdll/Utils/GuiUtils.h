@@ -3,6 +3,7 @@
 // ReSharper disable once CppUnusedIncludeDirective
 #include <ImGuiAddons.h>
 #include <nlohmann/json.hpp>
+#include <span>
 #include <ToolboxIni.h>
 
 #ifndef DLLAPI
@@ -51,10 +52,12 @@ namespace GuiUtils {
 
     std::string ToSlug(std::string s);
     std::wstring ToSlug(std::wstring s);
+    // Only A-Z are lowered
     std::string ToLower(std::string s);
     std::wstring ToLower(std::wstring s);
     std::string UrlEncode(const std::string& s, char space_token = '_');
     std::string HtmlEncode(const std::string& s);
+    // Only ASCII punctuation is removed
     std::wstring RemovePunctuation(std::wstring s);
     std::string RemovePunctuation(std::string s);
     std::wstring RemoveDiacritics(const std::wstring& s);
@@ -65,6 +68,18 @@ namespace GuiUtils {
     std::wstring SanitiseFilename(std::wstring_view str);
     std::wstring SanitizePlayerName(std::wstring_view str);
 
+    // Variants of the above for per-message and per-frame callers. They write into a buffer the caller keeps around,
+    // or modify the string in place, so they don't allocate once the buffer is big enough.
+    void ToLower(std::wstring_view in, std::wstring& out);
+    void ToLowerInPlace(std::span<wchar_t> s);
+    void ToLowerInPlace(std::span<char> s);
+    void RemoveDiacritics(std::wstring_view in, std::wstring& out);
+    void RemoveDiacriticsInPlace(std::span<wchar_t> s);
+    void RemovePunctuationInPlace(std::wstring& s);
+    void WStringToString(std::wstring_view str, std::string& out);
+    void StringToWString(std::string_view str, std::wstring& out);
+    void SanitizePlayerName(std::wstring_view str, std::wstring& out);
+
     // Extract first unencoded substring from gw encoded string. Pass second and third args to know where the player name was found in the original string.
     std::wstring GetPlayerNameFromEncodedString(const wchar_t* message, const wchar_t** start_pos_out = nullptr, const wchar_t** out_pos_out = nullptr);
 
@@ -0,0 +1,222 @@
+#include "stdafx.h"
+
+#include "TextureAtlas.h"
+
+namespace {
+    constexpr UINT page_size = 1024;
+    // Anything bigger isn't an icon; not worth the page space
+    constexpr UINT max_icon_size = 128;
+    // Edge pixels are repeated this far around each icon so linear filtering doesn't bleed in its neighbours
+    constexpr UINT padding = 1;
+
+    // Shelf packing: each page is split into horizontal shelves, filled left to right.
+    struct Shelf {
+        UINT y = 0;
+        UINT height = 0;
+        UINT used_width = 0;
+    };
+    struct Page {
+        IDirect3DTexture9* texture = nullptr;
+        std::vector<Shelf> shelves;
+        UINT used_height = 0;
+    };
+    std::vector<Page> pages;
+    struct Cell {
+        size_t page = 0;
+        UINT x = 0;
+        UINT y = 0;
+        UINT w = 0;
+        UINT h = 0;
+    };
+    struct Placed {
+        TextureAtlas::Region region;
+        Cell cell;
+    };
+    std::unordered_map<ImTextureID, Placed> regions;
+    // Cells given back by Remove
+    std::vector<Cell> free_cells;
+    size_t rejected = 0;
+    uint64_t used_area = 0;
+
+    // Find room for a w x h cell. Reuses a removed cell of the same size if there is one, else prefers the shortest
+    // shelf it fits on as long as that doesn't waste more than a quarter of the shelf's height; otherwise starts
+    // a new shelf, then a new page.
+    bool Allocate(IDirect3DDevice9* device, const UINT w, const UINT h, Cell& cell)
+    {
+        const auto free_cell = std::ranges::find_if(free_cells, [w, h](const Cell& c) {
+            return c.w == w && c.h == h;
+        });
+        if (free_cell != free_cells.end()) {
+            cell = *free_cell;
+            free_cells.erase(free_cell);
+            return true;
+        }
+        size_t best_page = pages.size();
+        Shelf* best_shelf = nullptr;
+        for (size_t i = 0; i < pages.size(); i++) {
+            for (auto& shelf : pages[i].shelves) {
+                if (shelf.height < h || shelf.height > h + h / 4 || shelf.used_width + w > page_size) {
+                    continue;
+                }
+                if (!best_shelf || shelf.height < best_shelf->height) {
+                    best_page = i;
+                    best_shelf = &shelf;
+                }
+            }
+        }
+        if (!best_shelf) {
+            best_page = static_cast<size_t>(std::ranges::find_if(pages, [h](const Page& page) {
+                return page.used_height + h <= page_size;
+            }) - pages.begin());
+            if (best_page == pages.size()) {
+                IDirect3DTexture9* texture = nullptr;
+                if (device->CreateTexture(page_size, page_size, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &texture, nullptr) != D3D_OK) {
+                    return false;
+                }
+                pages.emplace_back(texture);
+            }
+            auto& page = pages[best_page];
+            best_shelf = &page.shelves.emplace_back(page.used_height, h, 0u);
+            page.used_height += h;
+        }
+        cell = {best_page, best_shelf->used_width, best_shelf->y, w, h};
+        best_shelf->used_width += w;
+        return true;
+    }
+
+    // Copy src (width x height, 32bpp) into dst, surrounded by padding pixels copied from its edges
+    void CopyPadded(const D3DLOCKED_RECT& src, const UINT width, const UINT height, const D3DLOCKED_RECT& dst)
+    {
+        const auto src_row = [&](const UINT row) {
+            return static_cast<const uint32_t*>(src.pBits) + static_cast<size_t>(std::min(row, height - 1)) * (src.Pitch / 4);
+        };
+        for (UINT row = 0; row < height + padding * 2; row++) {
+            const uint32_t* in = src_row(row < padding ? 0 : row - padding);
+            auto out = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(dst.pBits) + static_cast<size_t>(row) * dst.Pitch);
+            for (UINT i = 0; i < padding; i++) {
+                *out++ = in[0];
+            }
+            memcpy(out, in, width * 4);
+            out += width;
+            for (UINT i = 0; i < padding; i++) {
+                *out++ = in[width - 1];
+            }
+        }
+    }
+}
+
+bool TextureAtlas::Add(IDirect3DDevice9* device, IDirect3DTexture9* texture)
+{
+    if (!(device && texture)) {
+        return false;
+    }
+    if (regions.contains(texture)) {
+        return true;
+    }
+    D3DSURFACE_DESC desc;
+    if (texture->GetLevelDesc(0, &desc) != D3D_OK
+        || desc.Format != D3DFMT_A8R8G8B8
+        || desc.Pool != D3DPOOL_MANAGED
+        || !desc.Width || !desc.Height
+        || desc.Width > max_icon_size || desc.Height > max_icon_size) {
+        rejected++;
+        return false;
+    }
+    Cell cell;
+    if (!Allocate(device, desc.Width + padding * 2, desc.Height + padding * 2, cell)) {
+        rejected++;
+        return false;
+    }
+    const auto page = pages[cell.page].texture;
+
+    D3DLOCKED_RECT src;
+    if (texture->LockRect(0, &src, nullptr, D3DLOCK_READONLY) != D3D_OK) {
+        free_cells.push_back(cell);
+        rejected++;
+        return false;
+    }
+    const RECT dst_rect = {static_cast<LONG>(cell.x), static_cast<LONG>(cell.y), static_cast<LONG>(cell.x + cell.w), static_cast<LONG>(cell.y + cell.h)};
+    D3DLOCKED_RECT dst;
+    if (page->LockRect(0, &dst, &dst_rect, 0) != D3D_OK) {
+        texture->UnlockRect(0);
+        free_cells.push_back(cell);
+        rejected++;
+        return false;
+    }
+    CopyPadded(src, desc.Width, desc.Height, dst);
+    page->UnlockRect(0);
+    texture->UnlockRect(0);
+
+    // Hold a reference so the address can't be reused by another texture while it's a key in here
+    texture->AddRef();
+    constexpr float px = 1.f / static_cast<float>(page_size);
+    const TextureAtlas::Region region = {
+        page,
+        {static_cast<float>(cell.x + padding) * px, static_cast<float>(cell.y + padding) * px},
+        {static_cast<float>(cell.x + padding + desc.Width) * px, static_cast<float>(cell.y + padding + desc.Height) * px}
+    };
+    regions[texture] = {region, cell};
+    used_area += static_cast<uint64_t>(cell.w) * cell.h;
+    return true;
+}
+
+void TextureAtlas::Remove(IDirect3DTexture9* texture)
+{
+    const auto found = regions.find(texture);
+    if (found == regions.end()) {
+        return;
+    }
+    const auto& cell = found->second.cell;
+    free_cells.push_back(cell);
+    used_area -= static_cast<uint64_t>(cell.w) * cell.h;
+    regions.erase(found);
+    texture->Release();
+}
+
+const TextureAtlas::Region* TextureAtlas::Find(const ImTextureID texture)
+{
+    if (!texture) {
+        return nullptr;
+    }
+    const auto found = regions.find(texture);
+    return found != regions.end() ? &found->second.region : nullptr;
+}
+
+void TextureAtlas::Remap(ImTextureID& texture, ImVec2& uv0, ImVec2& uv1)
+{
+    const auto region = Find(texture);
+    if (!region) {
+        return;
+    }
+    const ImVec2 size = {region->uv1.x - region->uv0.x, region->uv1.y - region->uv0.y};
+    texture = region->page;
+    uv0 = {region->uv0.x + uv0.x * size.x, region->uv0.y + uv0.y * size.y};
+    uv1 = {region->uv0.x + uv1.x * size.x, region->uv0.y + uv1.y * size.y};
+}
+
+void TextureAtlas::Clear()
+{
+    for (const auto texture : regions | std::views::keys) {
+        static_cast<IDirect3DTexture9*>(texture)->Release();
+    }
+    regions.clear();
+    for (const auto& page : pages) {
+        page.texture->Release();
+    }
+    pages.clear();
+    free_cells.clear();
+    rejected = 0;
+    used_area = 0;
+}
+
+TextureAtlas::Stats TextureAtlas::GetStats()
+{
+    Stats stats;
+    stats.pages = pages.size();
+    stats.icons = regions.size();
+    stats.rejected = rejected;
+    if (!pages.empty()) {
+        stats.used = static_cast<float>(static_cast<double>(used_area) / (static_cast<double>(page_size) * page_size * pages.size()));
+    }
+    return stats;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// Packs small icons (skills, professions, items) into shared pages so ImGui can draw a window full of them
+// from one texture instead of switching texture, and issuing a draw call, per icon.
+// The original textures stay valid; the ImGuiAddons image helpers look them up here and draw from the page instead.
+// Render thread only.
+namespace TextureAtlas {
+    struct Region {
+        IDirect3DTexture9* page = nullptr;
+        ImVec2 uv0;
+        ImVec2 uv1;
+    };
+    struct Stats {
+        size_t pages = 0;
+        size_t icons = 0;
+        size_t rejected = 0; // Too big, or not A8R8G8B8
+        float used = 0.f; // Fraction of page area taken up by icons
+    };
+
+    // Copy the texture into the atlas. Returns false if it doesn't qualify; keep drawing the texture itself then.
+    bool Add(IDirect3DDevice9* device, IDirect3DTexture9* texture);
+    // Where the texture lives in the atlas, or nullptr if it isn't in there
+    const Region* Find(ImTextureID texture);
+    // Drop the texture from the atlas, e.g. before releasing it; its cell is reused by the next icon of the same size
+    void Remove(IDirect3DTexture9* texture);
+    // Point texture and uv coords (relative to the original texture) at its atlas page. Leaves them alone if it isn't in there.
+    void Remap(ImTextureID& texture, ImVec2& uv0, ImVec2& uv1);
+    // Release all pages
+    void Clear();
+
+    Stats GetStats();
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <future>
+#include <optional>
+#include <GWCA/Managers/GameThreadMgr.h>
+
 namespace GW {
     struct Player;
     struct Agent;
@@ -93,4 +97,29 @@ namespace ToolboxUtils {
     GW::Friend* GetFriend(const wchar_t* account, const wchar_t* playing, GW::FriendType type, GW::FriendStatus status);
 
     std::wstring ShorthandItemDescription(GW::Item* item);
+
+    // Threads
+
+    // Runs func on the game thread and blocks the calling thread until it has run, returning its result.
+    // Empty if GW dropped the callback without running it, e.g. because the game thread is shutting down.
+    // Never call this from the game thread itself; it would wait for itself forever.
+    template <typename Func>
+    auto RunOnGameThread(Func&& func) -> std::optional<std::invoke_result_t<Func>>
+    {
+        using Result = std::invoke_result_t<Func>;
+        static_assert(!std::is_void_v<Result>, "RunOnGameThread needs a result to tell whether func ran");
+        // GW::GameThread::Enqueue needs a copyable callable, so the task lives in a shared_ptr.
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+        auto result = task->get_future();
+        GW::GameThread::Enqueue([task] {
+            (*task)();
+        });
+        try {
+            return result.get();
+        }
+        catch (const std::future_error&) {
+            // broken_promise: the last copy of the callback was destroyed without being called
+            return std::nullopt;
+        }
+    }
 };
@@ -16,6 +16,7 @@
 #include <GWCA/Packets/StoC.h>
 
 #include <Defines.h>
+#include <ImGuiAddons.h>
 #include <Modules/Resources.h>
 #include <Widgets/SkillMonitorWidget.h>
 
@@ -387,7 +388,7 @@ void SkillMonitorWidget::Draw(IDirect3DDevice9*)
                 ImVec2 br = GetGridPos(xIndex, y, false);
 
                 if (texture) {
-                    ImGui::GetWindowDrawList()->AddImage(texture, tl, br);
+                    ImGui::AddImageAtlased(ImGui::GetWindowDrawList(), texture, tl, br);
                 }
 
                 if (status_border_thickness != 0) {
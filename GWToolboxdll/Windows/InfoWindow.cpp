@@ -52,6 +52,7 @@
 #include <GWCA/Utilities/Hooker.h>
 #include <Modules/GwDatTextureModule.h>
 #include <Utils/ToolboxUtils.h>
+#include <Utils/TextureAtlas.h>
 #include <GWCA/Context/MapContext.h>
 
 namespace {
@@ -710,21 +711,12 @@ namespace {
         fileHash[2] = 0;
     }
 
-    uint32_t FileHashToFileId(wchar_t* param_1) {
-        if (!param_1)
-            return 0;
-        if (((0xff < *param_1) && (0xff < param_1[1])) &&
-            ((param_1[2] == 0 || ((0xff < param_1[2] && (param_1[3] == 0)))))) {
-            return (*param_1 - 0xff00ff) + (uint32_t)param_1[1] * 0xff00;
-        }
-        return 0;
-    }
-
     uint32_t* OnCreateTexture(wchar_t* file_name, uint32_t flags) {
         GW::Hook::EnterHook();
         const auto out = CreateTexture_Ret(file_name, flags);
-        uint32_t file_id = FileHashToFileId(file_name);
-        if (textures_created_by_file_id.find(file_id) == textures_created_by_file_id.end()) {
+        // Only while the Loaded Textures section is open; otherwise every texture GW creates would be decoded a second time
+        const uint32_t file_id = record_textures ? GwDatTextureModule::FileHashToFileId(file_name) : 0;
+        if (file_id && !textures_created_by_file_id.contains(file_id)) {
             const auto f = GwDatTextureModule::LoadTextureFromFileId(file_id);
             textures_created.push_back(f);
             textures_created_by_file_id[file_id] = f;
@@ -759,6 +751,48 @@ namespace {
             DrawItemInfo(GW::Items::GetItemById(quoted_item_id), &quoted_name);
         }
 
+        if (ImGui::CollapsingHeader("Frame Times")) {
+            ImGui::PushID("frame_times");
+            const auto& stats = Resources::GetFrameStats();
+            if (ImGui::SmallButton("Reset")) {
+                Resources::ResetFrameStats();
+            }
+            std::string bucket_labels;
+            for (const auto bucket : Resources::frame_time_buckets) {
+                bucket_labels += std::format("<{:.1f} ", static_cast<float>(bucket) / 1000.f);
+            }
+            bucket_labels += "slower (ms)";
+            const auto plot = [](const char* label, const decltype(stats.frame_time)& buckets) {
+                std::array<float, std::tuple_size_v<decltype(stats.frame_time)>> values{};
+                uint32_t total = 0;
+                for (size_t i = 0; i < buckets.size(); i++) {
+                    values[i] = static_cast<float>(buckets[i]);
+                    total += buckets[i];
+                }
+                const auto overlay = std::format("{} frames", total);
+                ImGui::PlotHistogram(label, values.data(), static_cast<int>(values.size()), 0, overlay.c_str(), 0.f, FLT_MAX, ImVec2(0, 80.f));
+            };
+            plot("Frame time", stats.frame_time);
+            plot("DxUpdate time", stats.dx_update_time);
+            ImGui::TextDisabled("%s", bucket_labels.c_str());
+            ImGui::Text("Textures uploaded: %zu, waiting: %zu, slowest upload: %.2f ms",
+                        stats.textures_uploaded, stats.pending_uploads, static_cast<float>(stats.max_upload.count()) / 1000.f);
+            const auto atlas = TextureAtlas::GetStats();
+            ImGui::Text("Icon atlas: %zu icons on %zu pages (%.0f%% used), %zu not packed", atlas.icons, atlas.pages, atlas.used * 100.f, atlas.rejected);
+            ImGui::Text("Draw calls last frame: %u", stats.draw_calls);
+            for (const auto& [window, count] : stats.draw_calls_by_window) {
+                ImGui::BulletText("%u - %s", count, window.empty() ? "(unnamed)" : window.c_str());
+            }
+            const auto workers = Resources::GetWorkerQueueStats();
+            ImGui::Text("Worker tasks waiting: %zu high, %zu normal, %zu low (deepest %zu)",
+                        workers.pending[static_cast<size_t>(Resources::WorkerPriority::High)],
+                        workers.pending[static_cast<size_t>(Resources::WorkerPriority::Normal)],
+                        workers.pending[static_cast<size_t>(Resources::WorkerPriority::Low)], workers.max_pending);
+            ImGui::Text("Worker tasks done: %zu, wait for a worker: %.2f ms avg, %.2f ms max", workers.completed,
+                        static_cast<float>(workers.avg_wait.count()) / 1000.f, static_cast<float>(workers.max_wait.count()) / 1000.f);
+            ImGui::PopID();
+        }
+
         record_textures = ImGui::CollapsingHeader("Loaded Textures");
         if (record_textures) {
             ImGui::PushID(&textures_created);
@@ -181,10 +181,10 @@ bool PartySearchWindow::TBParty::FromRegionParty(const GW::PartySearch* party)
     district = party->district;
     language = static_cast<uint8_t>(party->language);
     region_id = static_cast<uint8_t>(GW::Map::GetRegion());
-    message = GuiUtils::WStringToString(party->message);
+    GuiUtils::WStringToString(party->message, message);
     primary = party->primary;
     secondary = party->secondary;
-    player_name = GuiUtils::WStringToString(party->party_leader);
+    GuiUtils::WStringToString(party->party_leader, player_name);
     Log::Log("Party %d updated\n", concat_party_id);
     return true;
 #pragma warning (pop)
@@ -209,7 +209,7 @@ bool PartySearchWindow::TBParty::FromPlayerInMap(const GW::Player* player)
     region_id = static_cast<uint8_t>(GW::Map::GetRegion());
     primary = player->primary;
     secondary = player->secondary;
-    player_name = GuiUtils::WStringToString(player->name);
+    GuiUtils::WStringToString(player->name, player_name);
     Log::Log("Party %d updated\n", concat_party_id);
     return true;
 #pragma warning (pop)
@@ -238,7 +238,7 @@ bool PartySearchWindow::TBParty::FromLocalParty(GW::PartyInfo* party)
     region_id = static_cast<uint8_t>(GW::Map::GetRegion());
     primary = player->primary;
     secondary = player->secondary;
-    player_name = GuiUtils::WStringToString(player->name);
+    GuiUtils::WStringToString(player->name, player_name);
     Log::Log("Party %d updated\n", concat_party_id);
     return true;
 #pragma warning (pop)
@@ -22,12 +22,18 @@
 
 #include <Windows/PathfindingWindow.h>
 #include <Modules/Resources.h>
+#include <Utils/GuiUtils.h>
 #include <Widgets/Minimap/Minimap.h>
 
 
 
 
 namespace {
+    // Only use reflex corners as visibility graph nodes; applies to maps processed after changing it.
+    bool reduced_visibility_graph = false;
+    // Save processed maps to disk, so they're ready straight away on the next visit.
+    bool cache_visibility_graphs = true;
+
     std::unordered_map<uint32_t, Pathing::MilePath*> mile_paths_by_map_file_id;
     // Returns milepath pointer for the current map, nullptr if we're not in a valid state
     Pathing::MilePath* GetMilepathForCurrentMap() {
@@ -37,7 +43,13 @@ namespace {
             return nullptr;
         if (mile_paths_by_map_file_id.contains(info->name_id))
             return mile_paths_by_map_file_id[info->name_id];
-        auto m = new Pathing::MilePath();
+        std::filesystem::path cache_folder;
+        if (cache_visibility_graphs) {
+            cache_folder = Resources::GetPath(L"pathing");
+            if (!Resources::EnsureFolderExists(cache_folder))
+                cache_folder.clear();
+        }
+        auto m = new Pathing::MilePath(reduced_visibility_graph, cache_folder);
         mile_paths_by_map_file_id[info->name_id] = m;
         return m;
     }
@@ -116,6 +128,71 @@ namespace {
         RecalculatePathTo(q->marker);
     }
 
+    // Saves the pathing map of the current map to the 'pathing/dumps' folder, to feed into Pathing::Benchmark later.
+    void DumpPathingMap() {
+        pending_worker_task = true;
+        Resources::EnqueueWorkerTask([] {
+            Pathing::PathingDump dump;
+            const auto res = Pathing::PathingDump::Capture(dump);
+            const auto folder = Resources::GetPath(L"pathing", L"dumps");
+            if (res != Pathing::Error::OK) {
+                Log::Error("Failed to capture pathing map; Pathing::Error code %d", res);
+            }
+            else if (Resources::EnsureFolderExists(folder)) {
+                const auto path = folder / std::format(L"{}.dump", static_cast<uint32_t>(dump.map_id));
+                if (dump.Save(path))
+                    Log::InfoW(L"Pathing map saved to %ls", path.c_str());
+            }
+            pending_worker_task = false;
+        });
+    }
+
+    Pathing::BenchmarkResult benchmark_result;
+    bool benchmark_running = false;
+    int benchmark_queries = 1000;
+
+    // Worker thread. Benchmarks the map in dump_file, or the current map if it's empty.
+    void BenchmarkDump(const std::filesystem::path& dump_file, bool reflex, size_t queries) {
+        Pathing::PathingDump dump;
+        Pathing::BenchmarkResult result;
+        if (dump_file.empty() ? Pathing::PathingDump::Capture(dump) == Pathing::Error::OK : Pathing::PathingDump::Load(dump_file, dump))
+            result = Pathing::Benchmark(dump, reflex, queries);
+        else if (!dump_file.empty())
+            Log::ErrorW(L"Failed to load pathing dump %ls", dump_file.c_str());
+        Resources::EnqueueMainTask([result] {
+            benchmark_result = result;
+            benchmark_running = false;
+        });
+        pending_worker_task = false;
+    }
+
+    void RunBenchmark() {
+        if (benchmark_running)
+            return;
+        benchmark_running = true;
+        pending_worker_task = true;
+        Resources::EnqueueWorkerTask([reflex = reduced_visibility_graph, queries = static_cast<size_t>(std::max(benchmark_queries, 1))] {
+            BenchmarkDump({}, reflex, queries);
+        });
+    }
+
+    // Same as RunBenchmark, on a map saved by DumpPathingMap
+    void RunBenchmarkFromFile() {
+        if (benchmark_running)
+            return;
+        benchmark_running = true;
+        const auto folder = Resources::GetPath(L"pathing", L"dumps");
+        Resources::OpenFileDialog([reflex = reduced_visibility_graph, queries = static_cast<size_t>(std::max(benchmark_queries, 1))](const char* result) {
+            if (!result) {
+                Resources::EnqueueMainTask([] { benchmark_running = false; });
+                return;
+            }
+            // The dialog already runs on a worker
+            pending_worker_task = true;
+            BenchmarkDump(GuiUtils::StringToWString(result), reflex, queries);
+        }, "dump", folder.string().c_str());
+    }
+
     void DrawPathOnMinimap() {
         if (!astar)
             return;
@@ -151,6 +228,39 @@ void PathfindingWindow::Draw(IDirect3DDevice9*)
         return ImGui::End();
     }
 
+    const auto& stats = current_milepath->stats();
+    ImGui::Text("Visibility graph: %d points, %d edges, %s in %d ms; broad phase %.2f ms", stats.point_count, stats.edge_count,
+                stats.loaded_from_cache ? "loaded from cache" : "built", stats.build_time, stats.broad_phase_time);
+
+    if (ImGui::Button("Dump pathing map")) {
+        DumpPathingMap();
+    }
+    ImGui::SameLine();
+    if (benchmark_running) {
+        ImGui::TextUnformatted("Benchmark running...");
+    }
+    else {
+        if (ImGui::Button("Benchmark")) {
+            RunBenchmark();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Benchmark dump file...")) {
+            RunBenchmarkFromFile();
+        }
+    }
+    ImGui::SameLine();
+    ImGui::PushItemWidth(100.f);
+    ImGui::InputInt("Queries", &benchmark_queries, 100, 1000);
+    ImGui::PopItemWidth();
+    if (benchmark_result.queries) {
+        const auto& b = benchmark_result;
+        ImGui::Text("Build: %d ms, %d points, %d edges, %d KB", b.stats.build_time, b.stats.point_count, b.stats.edge_count, b.stats.memory_usage / 1024);
+        ImGui::Text("Broad phase: sweep %.2f ms, all pairs %.2f ms", b.stats.broad_phase_time, b.all_pairs_broad_phase_time);
+        ImGui::Text("%d queries, %d paths found, %d differ from reference", b.queries, b.paths_found, b.mismatches);
+        ImGui::Text("Search: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms; reference avg %.3f ms", b.p50, b.p90, b.p99, b.max, b.reference_avg);
+        ImGui::Text("Throughput: %.0f/s on 1 thread, %.0f/s on %d threads; %d concurrent searches differ", b.qps, b.concurrent_qps, b.threads, b.concurrent_mismatches);
+    }
+
     auto player = GW::Agents::GetPlayer();
     if (!player) {
         return ImGui::End();
@@ -221,6 +331,28 @@ void PathfindingWindow::Draw(IDirect3DDevice9*)
     ImGui::End();
 }
 
+void PathfindingWindow::DrawSettingsInternal()
+{
+    ImGui::Checkbox("Reduced visibility graph", &reduced_visibility_graph);
+    ImGui::ShowHelp("Only use reflex corners of the walkable area as pathing nodes.\nMuch faster to build with the same paths. Applies to maps that haven't been processed yet.");
+    ImGui::Checkbox("Cache visibility graphs on disk", &cache_visibility_graphs);
+    ImGui::ShowHelp("Saves processed maps in the 'pathing' folder, so they're ready straight away on the next visit.");
+}
+
+void PathfindingWindow::LoadSettings(ToolboxIni* ini)
+{
+    ToolboxWindow::LoadSettings(ini);
+    LOAD_BOOL(reduced_visibility_graph);
+    LOAD_BOOL(cache_visibility_graphs);
+}
+
+void PathfindingWindow::SaveSettings(ToolboxIni* ini)
+{
+    ToolboxWindow::SaveSettings(ini);
+    SAVE_BOOL(reduced_visibility_graph);
+    SAVE_BOOL(cache_visibility_graphs);
+}
+
 void PathfindingWindow::SignalTerminate()
 {
     ToolboxWindow::SignalTerminate();
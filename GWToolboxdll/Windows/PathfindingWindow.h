@@ -24,6 +24,9 @@ public:
     void Initialize() override;
 
     void Draw(IDirect3DDevice9* pDevice) override;
+    void DrawSettingsInternal() override;
+    void LoadSettings(ToolboxIni* ini) override;
+    void SaveSettings(ToolboxIni* ini) override;
     void SignalTerminate() override;
     bool CanTerminate() override;
     void Terminate() override;
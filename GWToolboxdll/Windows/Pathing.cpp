@@ -1,5 +1,8 @@
 #include <thread>
+#include <atomic>
 #include <algorithm>
+#include <chrono>
+#include <random>
 #include <GWCA/Managers/MapMgr.h>
 #include <GWCA/Managers/GameThreadMgr.h>
 
@@ -8,40 +11,140 @@
 #include <GWCA/Context/MapContext.h>
 #include <GWCA/GWCA.h>
 #include <Logger.h>
+#include <Utils/ToolboxUtils.h>
 
 #include "MathUtility.h"
 #include "Pathing.h"
 
 namespace {
     
-    std::mutex pathing_mutex;
-
     // Grab a copy of map_context->sub1->pathing_map_block for processing on a different thread - Blocks until copy is complete
     Pathing::Error CopyPathingMapBlocks(std::vector<uint32_t>& block) {
-        auto block_pt = &block;
-        volatile Pathing::Error res = Pathing::Error::Unknown;
-        std::mutex mutex;
-        auto res_pt = &res;
-        // Enqueue
-        GW::GameThread::Enqueue([&block_pt, res_pt, &mutex] {
-            const std::lock_guard lock(mutex);
+        return ToolboxUtils::RunOnGameThread([&block] {
             GW::MapContext* mapContext = GW::GetMapContext();
             if (!mapContext) {
-                *res_pt = Pathing::Error::InvalidMapContext;
-                return;
+                return Pathing::Error::InvalidMapContext;
             }
-            GW::Array<uint32_t>& block = mapContext->sub1->pathing_map_block;
-            if(block.m_size)
-                block_pt->assign(block.m_buffer, block.m_buffer + block.m_size);
-            *res_pt = Pathing::Error::OK;
-            });
-        // Wait
-        do {
-            const std::lock_guard lock(mutex);
-            if (res != Pathing::Error::Unknown)
-                break;
-        } while (true);
-        return res;
+            GW::Array<uint32_t>& pathing_map_block = mapContext->sub1->pathing_map_block;
+            if (pathing_map_block.m_size)
+                block.assign(pathing_map_block.m_buffer, pathing_map_block.m_buffer + pathing_map_block.m_size);
+            return Pathing::Error::OK;
+        }).value_or(Pathing::Error::FailedToGetPathingMapBlock);
+    }
+
+    // On-disk layout of the MilePath cache: header, portals, points, edge offsets per point, edges, blocking ids.
+    // Boxes are referenced by AABB::m_id; the AABBs themselves are rebuilt from the map, which the hash guarantees to match.
+    constexpr uint32_t cache_magic = 0x4854504D; // "MPTH"
+    constexpr uint32_t cache_version = 1;
+
+    struct CacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t map_id;
+        uint32_t reflex_points_only;
+        uint64_t map_hash;
+        float visibility_range;
+        uint32_t aabb_count;
+        uint32_t portal_count;
+        uint32_t point_count;
+        uint32_t edge_count;
+        uint32_t blocking_id_count;
+    };
+
+    struct CachedPortal {
+        GW::Vec2f start, goal;
+        uint32_t box1, box2;
+    };
+
+    constexpr uint32_t no_index = 0xFFFFFFFF;
+    struct CachedPoint {
+        GW::Vec2f pos;
+        uint32_t box, box2, portal;
+    };
+
+    struct CachedEdge {
+        uint32_t point_id;
+        float distance;
+        uint32_t blocking_offset;
+        uint32_t blocking_count;
+    };
+
+    // On-disk layout of a PathingDump: header, trapezoids, blocks, teleports.
+    constexpr uint32_t dump_magic = 0x5044504D; // "MPDP"
+    constexpr uint32_t dump_version = 1;
+
+    struct DumpHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t map_id;
+        uint32_t trapezoid_count;
+        uint32_t block_count;
+        uint32_t teleport_count;
+    };
+
+    struct DumpedTrapezoid {
+        uint32_t id, layer;
+        GW::Vec2f a, b, c, d;
+        float alt_a, alt_b, alt_c, alt_d;
+    };
+
+    struct DumpedTeleport {
+        GW::GamePos enter, exit;
+        uint32_t directionality;
+    };
+
+    // Read-only memory mapping of a whole file.
+    class MappedFile {
+    public:
+        MappedFile(const std::filesystem::path& path) {
+            m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (m_file == INVALID_HANDLE_VALUE) return;
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(m_file, &size) || !size.QuadPart || size.HighPart) return;
+            m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!m_mapping) return;
+            m_view = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+            if (m_view) m_size = size.LowPart;
+        }
+        ~MappedFile() {
+            if (m_view) UnmapViewOfFile(m_view);
+            if (m_mapping) CloseHandle(m_mapping);
+            if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        std::span<const uint8_t> data() const { return { m_view, m_size }; }
+
+    private:
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+        HANDLE m_mapping = nullptr;
+        const uint8_t* m_view = nullptr;
+        size_t m_size = 0;
+    };
+
+    // Takes count elements of T from the front of data; false if there aren't enough bytes left.
+    template <typename T>
+    bool ReadArray(std::span<const uint8_t>& data, size_t count, std::span<const T>& out) {
+        if (count > data.size() / sizeof(T)) return false;
+        out = { reinterpret_cast<const T*>(data.data()), count };
+        data = data.subspan(count * sizeof(T));
+        return true;
+    }
+
+    template <typename T>
+    void WriteArray(std::ofstream& out, const std::vector<T>& in) {
+        out.write(reinterpret_cast<const char*>(in.data()), in.size() * sizeof(T));
+    }
+
+    // FNV-1a
+    uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+        const auto bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
     }
 }
 
@@ -88,11 +191,18 @@ namespace Pathing {
         return height;
     }
 
+    void SimplePT::SampleAltitudes() {
+        alt_a = height(a, layer);
+        alt_b = height(b, layer);
+        alt_c = height(c, layer);
+        alt_d = height(d, layer);
+    }
+
     SimplePT::adjacentSide SimplePT::TouchingHeight(const SimplePT &rhs, float max_height_diff) const {
         if (a.x != d.x && rhs.b.x != rhs.c.x && a.y == rhs.b.y) {
             //a bot, b top
             if (collinear(a, d, rhs.b, rhs.c)) {
-                float dh = (fabsf(height(a, layer) - height(rhs.b, rhs.layer)) + fabsf(height(d, layer) - height(rhs.c, rhs.layer))) / 2.0f;
+                float dh = (fabsf(alt_a - rhs.alt_b) + fabsf(alt_d - rhs.alt_c)) / 2.0f;
                 if (dh > max_height_diff)
                     return adjacentSide::none;
                 return adjacentSide::aBottom_bTop;
@@ -101,7 +211,7 @@ namespace Pathing {
         if (b.x != c.x && rhs.a.x != rhs.d.x && b.y == rhs.a.y) {
             //a top, b bot
             if (collinear(c, b, rhs.d, rhs.a)) {
-                float dh = (fabsf(height(b, layer) - height(rhs.a, rhs.layer)) + fabsf(height(c, layer) - height(rhs.d, rhs.layer))) / 2.0f;
+                float dh = (fabsf(alt_b - rhs.alt_a) + fabsf(alt_c - rhs.alt_d)) / 2.0f;
                 if (dh > max_height_diff)
                     return adjacentSide::none;
                 return adjacentSide::aTop_bBottom;
@@ -110,14 +220,14 @@ namespace Pathing {
 
         //a right, b left
         if (collinear(a, b, rhs.c, rhs.d)) {
-            float dh = (fabsf(height(a, layer) - height(rhs.d, rhs.layer)) + fabsf(height(b, layer) - height(rhs.c, rhs.layer))) / 2.0f;
+            float dh = (fabsf(alt_a - rhs.alt_d) + fabsf(alt_b - rhs.alt_c)) / 2.0f;
             if (dh > max_height_diff)
                 return adjacentSide::none;
             return adjacentSide::aRight_bLeft;
         }
         //a left, b right
         if (collinear(d, c, rhs.b, rhs.a)) {
-            float dh = (fabsf(height(c, layer) - height(rhs.b, rhs.layer)) + fabsf(height(d, layer) - height(rhs.a, rhs.layer))) / 2.0f;
+            float dh = (fabsf(alt_c - rhs.alt_b) + fabsf(alt_d - rhs.alt_a)) / 2.0f;
             if (dh > max_height_diff)
                 return adjacentSide::none;
             return adjacentSide::aLeft_bRight;
@@ -202,25 +312,171 @@ namespace Pathing {
         return true;
     }
 
+    void AABBGrid::clear() {
+        m_min = {};
+        m_invCellSize = 0.0f;
+        m_width = m_height = 0;
+        m_cellStart.clear();
+        m_items.clear();
+    }
+
+    void AABBGrid::cellCoords(float x, float y, uint32_t &cx, uint32_t &cy) const {
+        const float fx = std::clamp((x - m_min.x) * m_invCellSize, 0.0f, static_cast<float>(m_width - 1));
+        const float fy = std::clamp((y - m_min.y) * m_invCellSize, 0.0f, static_cast<float>(m_height - 1));
+        cx = static_cast<uint32_t>(fx);
+        cy = static_cast<uint32_t>(fy);
+    }
+
+    void AABBGrid::build(const std::vector<AABB> &aabbs) {
+        clear();
+        if (aabbs.empty()) return;
+
+        //boxes are padded so points lying exactly on a trapezoid edge still land in a cell that holds it.
+        constexpr float padding = 1.0f;
+        //upper bound for cells per axis, keeps memory in check on huge sparse maps.
+        constexpr float max_cells_per_axis = 1024.0f;
+
+        Vec2f min = { INFINITY, INFINITY }, max = { -INFINITY, -INFINITY };
+        for (const auto &box : aabbs) {
+            min.x = std::min(min.x, box.m_pos.x - box.m_half.x - padding);
+            min.y = std::min(min.y, box.m_pos.y - box.m_half.y - padding);
+            max.x = std::max(max.x, box.m_pos.x + box.m_half.x + padding);
+            max.y = std::max(max.y, box.m_pos.y + box.m_half.y + padding);
+        }
+        const Vec2f extent = max - min;
+
+        //aim for roughly one box per cell.
+        float cell_size = sqrtf(extent.x * extent.y / static_cast<float>(aabbs.size()));
+        cell_size = std::max({ cell_size, extent.x / max_cells_per_axis, extent.y / max_cells_per_axis, 1.0f });
+
+        m_min = min;
+        m_invCellSize = 1.0f / cell_size;
+        m_width = static_cast<uint32_t>(extent.x * m_invCellSize) + 1;
+        m_height = static_cast<uint32_t>(extent.y * m_invCellSize) + 1;
+
+        //counting pass, then fill pass, so every cell is a contiguous range of m_items.
+        m_cellStart.assign(m_width * m_height + 1, 0);
+        auto for_each_cell = [this](const AABB &box, auto &&fn) {
+            uint32_t x0, y0, x1, y1;
+            cellCoords(box.m_pos.x - box.m_half.x - padding, box.m_pos.y - box.m_half.y - padding, x0, y0);
+            cellCoords(box.m_pos.x + box.m_half.x + padding, box.m_pos.y + box.m_half.y + padding, x1, y1);
+            for (uint32_t y = y0; y <= y1; ++y) {
+                for (uint32_t x = x0; x <= x1; ++x) {
+                    fn(y * m_width + x);
+                }
+            }
+        };
+        for (const auto &box : aabbs) {
+            for_each_cell(box, [this](uint32_t cell) { ++m_cellStart[cell + 1]; });
+        }
+        for (size_t i = 1; i < m_cellStart.size(); ++i) {
+            m_cellStart[i] += m_cellStart[i - 1];
+        }
+        m_items.resize(m_cellStart.back());
+        std::vector<uint32_t> fill(m_cellStart.begin(), m_cellStart.end() - 1);
+        for (const auto &box : aabbs) {
+            for_each_cell(box, [this, &fill, &box](uint32_t cell) { m_items[fill[cell]++] = &box; });
+        }
+    }
+
+    std::span<const AABB* const> AABBGrid::query(const Vec2f &p) const {
+        if (m_cellStart.empty()) return {};
+        const float fx = (p.x - m_min.x) * m_invCellSize;
+        const float fy = (p.y - m_min.y) * m_invCellSize;
+        if (fx < 0.0f || fy < 0.0f || fx >= static_cast<float>(m_width) || fy >= static_cast<float>(m_height))
+            return {};
+        const uint32_t cell = static_cast<uint32_t>(fy) * m_width + static_cast<uint32_t>(fx);
+        return { m_items.data() + m_cellStart[cell], m_items.data() + m_cellStart[cell + 1] };
+    }
+
     void MilePath::LoadMapSpecificData() {
-        m_msd = MapSpecific::MapSpecificData(Map::GetMapID());
+        m_mapId = Map::GetMapID();
+        m_msd = MapSpecific::MapSpecificData(m_mapId);
         m_teleports = m_msd.m_teleports;
     }
 
-    MilePath::MilePath() {
+    MilePath::MilePath(bool reflex_points_only, const std::filesystem::path& cache_folder) : m_reflexPointsOnly(reflex_points_only) {
         m_processing = true;
-        static volatile clock_t start = clock();
-        start = clock();
+        if (m_reflexPointsOnly)
+            m_visibility_range = INFINITY;
+        const clock_t start = clock();
         LoadMapSpecificData();
+        LoadTrapezoids();
+        const auto broad_phase_start = std::chrono::steady_clock::now();
         GenerateAABBs();
-        GenerateAABBGraph(); //not threaded because it relies on gw client Query altitude.
-        worker_thread = new std::thread([&] {
-            GeneratePoints();
-            GenerateVisibilityGraph();
-            GenerateTeleportGraph();
-            InsertTeleportsIntoVisibilityGraph();
+        m_mapHash = ComputeMapHash();
+        if (!cache_folder.empty()) {
+            m_cacheFile = cache_folder / std::format(L"{}_{:016x}_{}.bin", static_cast<uint32_t>(m_mapId), m_mapHash, m_reflexPointsOnly ? 1 : 0);
+        }
+        const bool cache_current = IsCacheCurrent();
+        std::vector<std::pair<AABB::boxId, AABB::boxId>> candidates;
+        if (!cache_current) {
+            candidates = FindAdjacentCandidates(); //not threaded because it relies on gw client Query altitude.
+        }
+        m_stats.broad_phase_time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - broad_phase_start).count();
+        Log::Info("AABB broad phase: %.2f ms, %d boxes\n", m_stats.broad_phase_time, m_aabbs.size());
+        StartProcessing(std::move(candidates), cache_current, start);
+    }
+
+    MilePath::MilePath(const PathingDump& dump, bool reflex_points_only, float visibility_range) : m_reflexPointsOnly(reflex_points_only) {
+        m_processing = true;
+        m_visibility_range = m_reflexPointsOnly ? INFINITY : visibility_range;
+        const clock_t start = clock();
+        m_mapId = dump.map_id;
+        m_msd.m_teleports = dump.teleports;
+        m_teleports = dump.teleports;
+        m_trapezoids = dump.trapezoids;
+        const auto broad_phase_start = std::chrono::steady_clock::now();
+        GenerateAABBs();
+        m_mapHash = ComputeMapHash();
+        auto candidates = FindAdjacentCandidates(false);
+        m_stats.broad_phase_time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - broad_phase_start).count();
+        StartProcessing(std::move(candidates), false, start);
+    }
+
+    void MilePath::StartProcessing(std::vector<std::pair<AABB::boxId, AABB::boxId>>&& candidates, bool use_cache, clock_t start) {
+        worker_thread = new std::thread([this, start, use_cache, candidates = std::move(candidates)]() mutable {
+            m_stats.loaded_from_cache = use_cache && LoadCache();
+            if (m_stats.loaded_from_cache) {
+                GenerateTeleportGraph();
+            }
+            else {
+                bool save_cache = true;
+                if (use_cache) {
+                    //the header matched but the rest didn't load. Throw it away and do what a cache miss does;
+                    //altitudes can only be sampled on the game thread, and only while the map is still loaded.
+                    std::error_code ec;
+                    std::filesystem::remove(m_cacheFile, ec);
+                    const bool sampled = ToolboxUtils::RunOnGameThread([this, &candidates] {
+                        if (Map::GetInstanceType() == Constants::InstanceType::Loading || Map::GetMapID() != m_mapId)
+                            return false;
+                        candidates = FindAdjacentCandidates();
+                        return true;
+                    }).value_or(false);
+                    if (!sampled) {
+                        //layers can't be told apart by height without altitudes; good enough for now, but not worth keeping.
+                        candidates = FindAdjacentCandidates(false);
+                        save_cache = false;
+                    }
+                }
+                GenerateAABBGraph(candidates);
+                GeneratePoints();
+                GenerateVisibilityGraph();
+                GenerateTeleportGraph();
+                InsertTeleportsIntoVisibilityGraph();
+                if (!m_terminateThread && save_cache)
+                    SaveCache();
+            }
+            GenerateTeleportHeuristic();
+            GenerateReverseVisibilityGraph();
             volatile clock_t stop = clock();
 
+            m_stats.point_count = m_points.size();
+            m_stats.edge_count = 0;
+            for (const auto &edges : m_visGraph)
+                m_stats.edge_count += edges.size();
+            m_stats.build_time = stop - start;
+            m_stats.memory_usage = MemoryUsage();
 
             Log::Info("Processing %s\n", m_terminateThread ? "terminated." : "done.");
             Log::Info("processing time: %d ms\n", stop - start);
@@ -230,6 +486,208 @@ namespace Pathing {
             });
             worker_thread->detach();
     }
+
+    size_t MilePath::MemoryUsage() const {
+        auto bytes = [](const auto& v) { return v.capacity() * sizeof(v[0]); };
+        size_t total = bytes(m_aabbs) + bytes(m_trapezoids) + bytes(m_portals) + bytes(m_points)
+            + bytes(m_teleportDistances) + bytes(m_teleportEntranceDistances)
+            + bytes(m_visGraph) + bytes(m_AABBgraph) + bytes(m_PTPortalGraph) + bytes(m_reverseVisGraph);
+        for (const auto& edges : m_visGraph) {
+            total += bytes(edges);
+            for (const auto& e : edges)
+                total += bytes(e.blocking_ids);
+        }
+        for (const auto& v : m_AABBgraph)
+            total += bytes(v);
+        for (const auto& v : m_PTPortalGraph)
+            total += bytes(v);
+        for (const auto& v : m_reverseVisGraph)
+            total += bytes(v);
+        return total;
+    }
+
+    uint64_t MilePath::ComputeMapHash() const {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (const auto& pt : m_trapezoids) {
+            hash = HashBytes(hash, &pt.id, sizeof(pt.id));
+            hash = HashBytes(hash, &pt.layer, sizeof(pt.layer));
+            for (const auto& v : { pt.a, pt.b, pt.c, pt.d }) {
+                hash = HashBytes(hash, &v.x, sizeof(v.x));
+                hash = HashBytes(hash, &v.y, sizeof(v.y));
+            }
+        }
+        for (const auto& tp : m_teleports) {
+            for (const auto& pos : { tp.m_enter, tp.m_exit }) {
+                hash = HashBytes(hash, &pos.x, sizeof(pos.x));
+                hash = HashBytes(hash, &pos.y, sizeof(pos.y));
+                hash = HashBytes(hash, &pos.zplane, sizeof(pos.zplane));
+            }
+            hash = HashBytes(hash, &tp.m_directionality, sizeof(tp.m_directionality));
+        }
+        return hash;
+    }
+
+    bool MilePath::IsCacheCurrent() const {
+        if (m_cacheFile.empty() || !std::filesystem::exists(m_cacheFile))
+            return false;
+
+        const MappedFile file(m_cacheFile);
+        auto data = file.data();
+
+        std::span<const CacheHeader> header;
+        if (!ReadArray(data, 1, header))
+            return false;
+        const auto& h = header.front();
+        if (h.magic != cache_magic || h.version != cache_version
+            || h.map_id != static_cast<uint32_t>(m_mapId) || h.map_hash != m_mapHash
+            || h.reflex_points_only != static_cast<uint32_t>(m_reflexPointsOnly)
+            || h.visibility_range != m_visibility_range || h.aabb_count != m_aabbs.size()) {
+            Log::Info("Pathing cache outdated: %ls\n", m_cacheFile.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool MilePath::LoadCache() {
+        if (!IsCacheCurrent())
+            return false;
+
+        const MappedFile file(m_cacheFile);
+        auto data = file.data();
+
+        std::span<const CacheHeader> header;
+        if (!ReadArray(data, 1, header))
+            return false;
+        const auto& h = header.front();
+
+        std::span<const CachedPortal> portals;
+        std::span<const CachedPoint> points;
+        std::span<const uint32_t> edge_offsets;
+        std::span<const CachedEdge> edges;
+        std::span<const uint32_t> blocking_ids;
+        if (!(ReadArray(data, h.portal_count, portals)
+            && ReadArray(data, h.point_count, points)
+            && ReadArray(data, static_cast<size_t>(h.point_count) + 1, edge_offsets)
+            && ReadArray(data, h.edge_count, edges)
+            && ReadArray(data, h.blocking_id_count, blocking_ids))) {
+            Log::Error("Pathing cache truncated: %ls\n", m_cacheFile.c_str());
+            return false;
+        }
+
+        auto box = [this](uint32_t id) -> const AABB* { return id < m_aabbs.size() ? &m_aabbs[id] : nullptr; };
+
+        m_AABBgraph.clear();
+        m_AABBgraph.resize(m_aabbs.size());
+        m_portals.clear();
+        m_portals.reserve(portals.size());
+        m_PTPortalGraph.clear();
+        m_PTPortalGraph.resize(m_aabbs.size() * 2, {});
+        for (const auto& portal : portals) {
+            const AABB *box1 = box(portal.box1), *box2 = box(portal.box2);
+            if (!box1 || !box2 || box1->m_t->id >= m_PTPortalGraph.size() || box2->m_t->id >= m_PTPortalGraph.size())
+                return false;
+            m_portals.emplace_back(portal.start, portal.goal, box1, box2);
+            m_PTPortalGraph[box1->m_t->id].emplace_back(&m_portals.back());
+            m_PTPortalGraph[box2->m_t->id].emplace_back(&m_portals.back());
+            m_AABBgraph[box1->m_id].emplace_back(box2);
+            m_AABBgraph[box2->m_id].emplace_back(box1);
+        }
+
+        m_points.clear();
+        m_points.reserve(points.size());
+        for (const auto& p : points) {
+            if (p.portal != no_index && p.portal >= m_portals.size())
+                return false;
+            m_points.emplace_back(static_cast<point::Id>(m_points.size()), p.pos, box(p.box), box(p.box2),
+                p.portal == no_index ? nullptr : &m_portals[p.portal]);
+        }
+
+        m_visGraph.clear();
+        m_visGraph.resize(std::max(m_portals.size() * 2 + m_teleports.size() * 2 + 2, m_points.size()));
+        for (size_t i = 0; i < points.size(); ++i) {
+            if (edge_offsets[i] > edge_offsets[i + 1] || edge_offsets[i + 1] > edges.size())
+                return false;
+            auto& vis = m_visGraph[i];
+            vis.reserve(edge_offsets[i + 1] - edge_offsets[i]);
+            for (const auto& e : edges.subspan(edge_offsets[i], edge_offsets[i + 1] - edge_offsets[i])) {
+                if (e.point_id >= points.size() || e.blocking_offset > blocking_ids.size()
+                    || e.blocking_count > blocking_ids.size() - e.blocking_offset)
+                    return false;
+                const auto ids = blocking_ids.subspan(e.blocking_offset, e.blocking_count);
+                vis.emplace_back(static_cast<point::Id>(e.point_id), e.distance, std::vector<uint32_t>(ids.begin(), ids.end()));
+            }
+        }
+        m_progress = 99;
+        Log::Info("Pathing cache loaded: %ls\n", m_cacheFile.c_str());
+        return true;
+    }
+
+    bool MilePath::SaveCache() const {
+        if (m_cacheFile.empty())
+            return false;
+
+        auto index_of = [](const auto* item, const auto& container) {
+            return item ? static_cast<uint32_t>(item - container.data()) : no_index;
+        };
+
+        std::vector<CachedPortal> portals;
+        portals.reserve(m_portals.size());
+        for (const auto& portal : m_portals) {
+            portals.emplace_back(portal.m_start, portal.m_goal, portal.m_box1->m_id, portal.m_box2->m_id);
+        }
+
+        std::vector<CachedPoint> points;
+        std::vector<uint32_t> edge_offsets;
+        std::vector<CachedEdge> edges;
+        std::vector<uint32_t> blocking_ids;
+        points.reserve(m_points.size());
+        edge_offsets.reserve(m_points.size() + 1);
+        for (const auto& p : m_points) {
+            points.emplace_back(p.pos, p.box ? p.box->m_id : no_index, p.box2 ? p.box2->m_id : no_index, index_of(p.portal, m_portals));
+            edge_offsets.push_back(static_cast<uint32_t>(edges.size()));
+            for (const auto& e : m_visGraph[p.id]) {
+                edges.emplace_back(static_cast<uint32_t>(e.point_id), e.distance, static_cast<uint32_t>(blocking_ids.size()), static_cast<uint32_t>(e.blocking_ids.size()));
+                blocking_ids.insert(blocking_ids.end(), e.blocking_ids.begin(), e.blocking_ids.end());
+            }
+        }
+        edge_offsets.push_back(static_cast<uint32_t>(edges.size()));
+
+        const CacheHeader header = {
+            cache_magic, cache_version, static_cast<uint32_t>(m_mapId), m_reflexPointsOnly ? 1u : 0u, m_mapHash, m_visibility_range,
+            static_cast<uint32_t>(m_aabbs.size()), static_cast<uint32_t>(portals.size()), static_cast<uint32_t>(points.size()),
+            static_cast<uint32_t>(edges.size()), static_cast<uint32_t>(blocking_ids.size())
+        };
+
+        // Write to a temporary file first so a half written cache is never picked up.
+        auto tmp_file = m_cacheFile;
+        tmp_file += L".tmp";
+        {
+            std::ofstream out(tmp_file, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                Log::Error("Failed to open pathing cache %ls\n", tmp_file.c_str());
+                return false;
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            WriteArray(out, portals);
+            WriteArray(out, points);
+            WriteArray(out, edge_offsets);
+            WriteArray(out, edges);
+            WriteArray(out, blocking_ids);
+            if (!out.good()) {
+                Log::Error("Failed to write pathing cache %ls\n", tmp_file.c_str());
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp_file, m_cacheFile, ec);
+        if (ec) {
+            Log::Error("Failed to save pathing cache %ls: %s\n", m_cacheFile.c_str(), ec.message().c_str());
+            std::filesystem::remove(tmp_file, ec);
+            return false;
+        }
+        return true;
+    }
+
     MilePath::~MilePath() {
         stopProcessing();
     }
@@ -285,6 +743,86 @@ namespace Pathing {
         }
     }
 
+    void MilePath::GenerateTeleportHeuristic() {
+        if (m_terminateThread) return;
+
+        using namespace MapSpecific;
+
+        const size_t n = m_teleports.size() * 2;
+        auto endpoint = [this](size_t e) -> const GamePos& {
+            const auto& tp = m_teleports[e / 2];
+            return e % 2 ? tp.m_exit : tp.m_enter;
+        };
+        auto is_entrance = [this](size_t e) {
+            return e % 2 == 0 || m_teleports[e / 2].m_directionality == Teleport::direction::both_ways;
+        };
+
+        //walking is at least the straight line distance, taking a teleport is free.
+        m_teleportDistances.assign(n * n, 0.0f);
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < n; ++j) {
+                m_teleportDistances[i * n + j] = i == j ? 0.0f : GetDistance(endpoint(i), endpoint(j));
+            }
+        }
+        for (size_t i = 0; i < m_teleports.size(); ++i) {
+            m_teleportDistances[(2 * i) * n + 2 * i + 1] = 0.0f;
+            if (m_teleports[i].m_directionality == Teleport::direction::both_ways)
+                m_teleportDistances[(2 * i + 1) * n + 2 * i] = 0.0f;
+        }
+        for (size_t k = 0; k < n; ++k) {
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t j = 0; j < n; ++j) {
+                    const float d = m_teleportDistances[i * n + k] + m_teleportDistances[k * n + j];
+                    if (d < m_teleportDistances[i * n + j])
+                        m_teleportDistances[i * n + j] = d;
+                }
+            }
+        }
+
+        m_teleportEntranceDistances.assign(m_points.size(), INFINITY);
+        for (size_t e = 0; e < n; ++e) {
+            if (!is_entrance(e)) continue;
+            const Vec2f pos = endpoint(e);
+            for (const auto& p : m_points) {
+                m_teleportEntranceDistances[p.id] = std::min(m_teleportEntranceDistances[p.id], GetDistance(p.pos, pos));
+            }
+        }
+    }
+
+    float MilePath::TeleportToGoalCost(const Vec2f& pos) const {
+        using namespace MapSpecific;
+
+        const size_t n = m_teleports.size() * 2;
+        if (m_teleportDistances.size() != n * n)
+            return INFINITY;
+
+        //any route through teleports goes from an entrance, via teleports and walking, to some endpoint, then to pos.
+        float cost = INFINITY;
+        for (size_t from = 0; from < n; ++from) {
+            if (from % 2 && m_teleports[from / 2].m_directionality != Teleport::direction::both_ways)
+                continue;
+            for (size_t to = 0; to < n; ++to) {
+                const auto& tp = m_teleports[to / 2];
+                const float d = m_teleportDistances[from * n + to] + GetDistance(to % 2 ? tp.m_exit : tp.m_enter, pos);
+                cost = std::min(cost, d);
+            }
+        }
+        return cost;
+    }
+
+    void MilePath::GenerateReverseVisibilityGraph() {
+        if (m_terminateThread) return;
+
+        m_reverseVisGraph.clear();
+        m_reverseVisGraph.resize(m_visGraph.size());
+        for (size_t from = 0; from < m_visGraph.size(); ++from) {
+            const auto& edges = m_visGraph[from];
+            for (size_t i = 0; i < edges.size(); ++i) {
+                m_reverseVisGraph[edges[i].point_id].emplace_back(static_cast<point::Id>(from), static_cast<uint32_t>(i));
+            }
+        }
+    }
+
     MilePath::point MilePath::CreatePoint(const GamePos& pos) {
         MilePath::point point;
         point.pos = pos;
@@ -296,34 +834,39 @@ namespace Pathing {
         return point;
     }
 
-    //Generate Axis Aligned Bounding Boxes around trapezoids
-    //This is used for quick intersection checks.
-    //AABB related stuff could be entirely omitted.
-    void MilePath::GenerateAABBs() {
+    void MilePath::LoadTrapezoids() {
         PathingMapArray* map = Map::GetPathingMap();
         MapContext* mapContex = GW::GetMapContext();
+        m_trapezoids.clear();
         if (!map || !mapContex) return;
         ASSERT(mapContex->sub1);
 
-        m_aabbs.clear();
-        m_aabbs.reserve(mapContex->sub1->total_trapezoid_count); //h0014[0] == total trapezoid count
-        m_trapezoids.clear();
-        m_trapezoids.reserve(mapContex->sub1->total_trapezoid_count);
-            
+        m_trapezoids.reserve(mapContex->sub1->total_trapezoid_count); //h0014[0] == total trapezoid count
         for (uint32_t i = 0; i < map->size(); ++i) {
             auto& m = (*map)[i];
             for (uint32_t j = 0; j < m.trapezoid_count; j++) {
                 const PathingTrapezoid* t = &m.trapezoids[j];
                 if (t->YB == t->YT) continue;
                 m_trapezoids.emplace_back( *t, i );
-                m_aabbs.emplace_back(m_trapezoids.back());
             }
         }
+    }
+
+    //Generate Axis Aligned Bounding Boxes around trapezoids
+    //This is used for quick intersection checks.
+    //AABB related stuff could be entirely omitted.
+    void MilePath::GenerateAABBs() {
+        m_aabbs.clear();
+        m_aabbs.reserve(m_trapezoids.size());
+        for (const auto& t : m_trapezoids) {
+            m_aabbs.emplace_back(t);
+        }
         std::sort(m_aabbs.begin(), m_aabbs.end(), [](AABB& a, AABB& b) { return a.m_pos.y - a.m_half.y > b.m_pos.y - b.m_half.y; });
         AABB::boxId id = 0;
         for (auto& box : m_aabbs) {
             box.m_id = id++;
         }
+        m_aabbGrid.build(m_aabbs);
     }
 
     bool MilePath::CreatePortal(const AABB* box1, const AABB* box2, const SimplePT::adjacentSide& ts)
@@ -410,8 +953,44 @@ namespace Pathing {
         return true;
     }
 
+    std::vector<std::pair<AABB::boxId, AABB::boxId>> MilePath::FindAdjacentCandidates(bool sample_altitudes) {
+        std::vector<std::pair<AABB::boxId, AABB::boxId>> candidates;
+        if (m_aabbs.empty()) return candidates;
+
+        //slightly larger than the padding used by the coarse intersection, so float rounding never drops a pair.
+        constexpr float sweep_padding = 2.0f;
+        auto bottom = [](const AABB &box) { return box.m_pos.y - box.m_half.y; };
+
+        //m_aabbs is sorted by descending bottom y. Walking it backwards sweeps upwards; the boxes that may touch
+        //box j are the preceding ones whose bottom is below the top of box j.
+        std::vector<bool> sample(m_trapezoids.size());
+        for (size_t j = m_aabbs.size(); j-- > 0;) {
+            const auto &b = m_aabbs[j];
+            const float top = b.m_pos.y + b.m_half.y + sweep_padding;
+            for (size_t i = j; i-- > 0;) {
+                const auto &a = m_aabbs[i];
+                if (bottom(a) > top) break;
+                //coarse intersection
+                if (!a.intersect(b, { 1.0f, 1.0f })) continue;
+                candidates.emplace_back(a.m_id, b.m_id);
+                if (a.m_t->layer != b.m_t->layer) {
+                    sample[a.m_t - m_trapezoids.data()] = true;
+                    sample[b.m_t - m_trapezoids.data()] = true;
+                }
+            }
+        }
+        //keep the pair order of a full i < j scan, so portals are created in the same order.
+        std::ranges::sort(candidates);
+
+        for (size_t i = 0; sample_altitudes && i < m_trapezoids.size(); ++i) {
+            if (sample[i])
+                m_trapezoids[i].SampleAltitudes();
+        }
+        return candidates;
+    }
+
     //Connect trapezoid AABBS.
-    void MilePath::GenerateAABBGraph() {
+    void MilePath::GenerateAABBGraph(const std::vector<std::pair<AABB::boxId, AABB::boxId>> &candidates) {
         if (m_terminateThread) return;
 
         m_AABBgraph.clear();
@@ -422,28 +1001,76 @@ namespace Pathing {
         m_PTPortalGraph.clear();
         m_PTPortalGraph.resize(m_aabbs.size() * 2, {});
 
-        for (size_t i = 0; i < m_aabbs.size(); ++i) {
-            for (size_t j = i + 1; j < m_aabbs.size(); ++j) {
-                //coarse intersection
-                if (!m_aabbs[i].intersect(m_aabbs[j], { 1.0f, 1.0f })) continue;
-                auto *a = &m_aabbs[i], *b = &m_aabbs[j];
-
-                //fine intersection
-                SimplePT::adjacentSide ts;
-                if (a->m_t->layer == b->m_t->layer)
-                    ts = a->m_t->Touching(*b->m_t);
-                else
-                    ts = a->m_t->TouchingHeight(*b->m_t);
-                if (ts == SimplePT::adjacentSide::none) continue;
-                if (CreatePortal(a, b, ts)) {
-                    m_AABBgraph[a->m_id].emplace_back(b);
-                    m_AABBgraph[b->m_id].emplace_back(a);
-                }
+        for (const auto &[i, j] : candidates) {
+            auto *a = &m_aabbs[i], *b = &m_aabbs[j];
+
+            //fine intersection
+            SimplePT::adjacentSide ts;
+            if (a->m_t->layer == b->m_t->layer)
+                ts = a->m_t->Touching(*b->m_t);
+            else
+                ts = a->m_t->TouchingHeight(*b->m_t);
+            if (ts == SimplePT::adjacentSide::none) continue;
+            if (CreatePortal(a, b, ts)) {
+                m_AABBgraph[a->m_id].emplace_back(b);
+                m_AABBgraph[b->m_id].emplace_back(a);
             }
         }
         Log::Info("Portal count: %d\n", m_portals.size());
     }
 
+    //Walkable angle of the trapezoid around p: its interior angle if p is one of its corners,
+    //pi if p lies on one of its edges, 0 otherwise.
+    static float WalkableAngle(const SimplePT &pt, const Vec2f &p) {
+        constexpr float tolerance = 1.0f;
+        constexpr float sqtolerance = tolerance * tolerance;
+
+        //triangles have two corners in the same place, drop the duplicate.
+        std::array<Vec2f, 4> corners;
+        size_t n = 0;
+        for (const auto &v : { pt.a, pt.b, pt.c, pt.d }) {
+            if (n && GetSquareDistance(corners[n - 1], v) < sqtolerance) continue;
+            corners[n++] = v;
+        }
+        if (n > 1 && GetSquareDistance(corners[n - 1], corners[0]) < sqtolerance) --n;
+        if (n < 3) return 0.0f;
+
+        for (size_t i = 0; i < n; ++i) {
+            const auto &v = corners[i];
+            if (GetSquareDistance(v, p) >= sqtolerance) continue;
+            const auto e1 = corners[(i + n - 1) % n] - v;
+            const auto e2 = corners[(i + 1) % n] - v;
+            return acosf(std::clamp(Dot(e1, e2) / sqrtf(GetSquaredNorm(e1) * GetSquaredNorm(e2)), -1.0f, 1.0f));
+        }
+        for (size_t i = 0; i < n; ++i) {
+            const auto &v = corners[i];
+            const auto vw = corners[(i + 1) % n] - v;
+            const float t = std::clamp(Dot(p - v, vw) / GetSquaredNorm(vw), 0.0f, 1.0f);
+            if (GetSquareDistance(v + vw * t, p) < sqtolerance)
+                return std::numbers::pi_v<float>;
+        }
+        return 0.0f;
+    }
+
+    bool MilePath::IsReflexPoint(const point &p) const {
+        //layers can be blocked at search time, which turns their borders into walls. Keep those points.
+        if (!p.box || !p.box2 || p.box->m_t->layer != p.box2->m_t->layer)
+            return true;
+
+        const uint32_t layer = p.box->m_t->layer;
+        float angle = 0.0f;
+        for (const auto *box : m_aabbGrid.query(p.pos)) {
+            if (box->m_t->layer == layer)
+                angle += WalkableAngle(*box->m_t, p.pos);
+        }
+
+        //convex corners (<= pi) and points surrounded by walkable ground (2 pi) are never on a shortest path.
+        //anything above 2 pi means overlapping trapezoids; keep the point to be safe.
+        constexpr float pi = std::numbers::pi_v<float>;
+        constexpr float eps = 0.01f;
+        return angle > pi + eps && fabsf(angle - 2.0f * pi) > eps;
+    }
+
     void MilePath::GeneratePoints() {
         if (m_terminateThread) return;
 
@@ -454,6 +1081,9 @@ namespace Pathing {
             m_points.emplace_back( 0, portal.m_start, portal.m_box1, portal.m_box2, &portal );
             m_points.emplace_back( 0, portal.m_goal, portal.m_box1, portal.m_box2, &portal );
         }
+        if (m_reflexPointsOnly) {
+            std::erase_if(m_points, [this](const point &p) { return !IsReflexPoint(p); });
+        }
 
         //Not needed. But if they are sorted binary search can be used.
         std::sort(m_points.begin(), m_points.end(), [](point& a, point& b) { return a.pos.y > b.pos.y; });
@@ -465,23 +1095,8 @@ namespace Pathing {
     }
 
     bool MilePath::IsOnPathingTrapezoid(const Vec2f &p, const SimplePT **ppt) {
-        //note: maybe use GW client O(logn) algorithm?
-        //constexpr float tolerance = 2.0f;
-        //auto lower = std::lower_bound(aabbs.begin(), aabbs.end(), p.y,
-        //    [](const AABB &box, const float &val) { return box.m_pos.y - box.m_half.y - tolerance < val; });
-        //auto upper = std::upper_bound(lower, aabbs.end(), p.y,
-        //    [](const float &val, const AABB &box) { return val < box.m_pos.y + box.m_half.y + tolerance; });
-
-        //for (auto it = lower; it < aabbs.end()/*upper*/; ++it) {
-        //    const SimplePT *pt = (*it).m_t;
-        //    if (IsOnPathingTrapezoid(pt, p)) {
-        //        if (ppt) *ppt = pt;
-        //        return true;
-        //    }
-        //}
-        const auto& aabbs = m_aabbs;
-        for (auto &box : aabbs) { 
-            const SimplePT *pt = box.m_t;            
+        for (const auto *box : m_aabbGrid.query(p)) {
+            const SimplePT *pt = box->m_t;
             if (pt->IsOnPathingTrapezoid(p)) {
                 if (ppt) *ppt = pt;
                 return true;
@@ -500,10 +1115,9 @@ namespace Pathing {
     }
 
     const AABB *MilePath::FindAABB(const GamePos &pos) {
-        const auto& aabbs = m_aabbs;
-        for (auto& a : aabbs) {
-            if (pos.zplane == a.m_t->layer && a.m_t->IsOnPathingTrapezoid(pos))
-                return &a;
+        for (const auto *box : m_aabbGrid.query(pos)) {
+            if (pos.zplane == box->m_t->layer && box->m_t->IsOnPathingTrapezoid(pos))
+                return box;
         }
         return nullptr;
     }
@@ -590,46 +1204,87 @@ namespace Pathing {
         if (m_terminateThread) return;
 
         //note: naive VG generation is O(n^3)
-        //TODO: great speedup if only checking visibility of convex points.
+        //The outer loop is split into chunks handed out to worker threads on demand; early chunks hold the most
+        //work, so they are taken first. Each chunk keeps its own edges, which are merged in chunk order afterwards
+        //to give the same graph as a single threaded run.
 
         m_visGraph.clear();
         m_visGraph.resize(m_portals.size() * 2 + m_teleports.size() * 2 + 2);
 
-        float range = m_visibility_range;
-        float sqrange = range * range;
-
-        std::vector<const AABB *> open;
-        std::vector<bool> visited;
-        size_t size = m_points.size();
-        for (size_t i = 0; i < size; ++i) {
-            auto& p1 = m_points[i];
-            float min_range = p1.pos.y - range;
-            float max_range = p1.pos.y + range;
+        struct Edge {
+            point::Id p1, p2;
+            float distance;
+            std::vector<uint32_t> blocking_ids;
+        };
 
-            for (size_t j = i + 1; j < size; ++j) {
-                auto& p2 = m_points[j];
+        constexpr size_t chunk_size = 16;
+        const size_t size = m_points.size();
+        const size_t chunk_count = (size + chunk_size - 1) / chunk_size;
+        std::vector<std::vector<Edge>> chunk_edges(chunk_count);
+        std::atomic<size_t> next_chunk = 0;
+        std::atomic<size_t> points_done = 0;
 
-                if (min_range > p2.pos.y || max_range < p2.pos.y)
-                    continue;
+        auto worker = [&] {
+            const float range = m_visibility_range;
+            const float sqrange = range * range;
+            std::vector<const AABB *> open;
+            std::vector<bool> visited;
 
-                float sqdist = GetSquareDistance(p1.pos, p2.pos);
-                if (sqdist > sqrange) 
-                    continue;
+            for (size_t chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++) {
+                auto &edges = chunk_edges[chunk];
+                const size_t end = std::min(size, (chunk + 1) * chunk_size);
+                for (size_t i = chunk * chunk_size; i < end; ++i) {
+                    auto& p1 = m_points[i];
+                    float min_range = p1.pos.y - range;
+                    float max_range = p1.pos.y + range;
+
+                    //every pair is only visited once, so there is no need to check for existing edges.
+                    for (size_t j = i + 1; j < size; ++j) {
+                        auto& p2 = m_points[j];
+
+                        if (min_range > p2.pos.y || max_range < p2.pos.y)
+                            continue;
+
+                        float sqdist = GetSquareDistance(p1.pos, p2.pos);
+                        if (sqdist > sqrange)
+                            continue;
+
+                        std::vector<uint32_t> blocking_ids;
+                        if (HasLineOfSight(p1, p2, open, visited, &blocking_ids)) {
+                            edges.emplace_back(p1.id, p2.id, sqrtf(sqdist), std::move(blocking_ids));
+                        }
+                    }
+                    //stays below 100 until the whole graph is done; see ready()
+                    const size_t done = points_done.fetch_add(1, std::memory_order_relaxed) + 1;
+                    if (done < size) {
+                        const auto percent_done = static_cast<int>(done * 100 / size - (done - 1) * 100 / size);
+                        if (percent_done)
+                            m_progress.fetch_add(percent_done, std::memory_order_relaxed);
+                    }
+                    if (m_terminateThread) return;
+                }
+            }
+        };
 
-                if (std::any_of(
-                    std::begin(m_visGraph[p1.id]), 
-                    std::end(m_visGraph[p1.id]), 
-                    [&p2](const PointVisElement &a) { return a.point_id == p2.id; })) continue;
+        const auto hardware_threads = std::thread::hardware_concurrency();
+        //leave a core for the game; this thread works too.
+        const size_t thread_count = std::min<size_t>(hardware_threads > 2 ? hardware_threads - 2 : 0, chunk_count);
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count);
+        for (size_t i = 0; i < thread_count; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        if (m_terminateThread) return;
 
-                std::vector<uint32_t> blocking_ids;
-                if (HasLineOfSight(p1, p2, open, visited, &blocking_ids)) {
-                    float dist = sqrtf(sqdist);
-                    m_visGraph[p1.id].emplace_back( p2.id, dist, blocking_ids );
-                    m_visGraph[p2.id].emplace_back( p1.id, dist, std::move(blocking_ids) );
-                }
+        for (auto &edges : chunk_edges) {
+            for (auto &edge : edges) {
+                m_visGraph[edge.p1].emplace_back( edge.p2, edge.distance, edge.blocking_ids );
+                m_visGraph[edge.p2].emplace_back( edge.p1, edge.distance, std::move(edge.blocking_ids) );
             }
-            m_progress = (i * 100) / size;
-            if (m_terminateThread) return;
         }
     }
 
@@ -689,20 +1344,7 @@ namespace Pathing {
         }
     };
 
-    AStar::AStar(MilePath* mp) : m_mp(mp), m_path(this) {
-        //Visibility graph challenge: integrating start and goal points requires careful
-        //handling to prevent continuous graph expansion and search slowdown. 
-        //Previous method involved copying the entire graph for each search.
-        //There's a slight improvement in performance by directly inserting and 
-        //subsequently removing start and stop points in the visibility graph.
-
-        //create temporary vis graph to hold start and goal points
-        m_visGraph.clear();
-        //m_visGraph.resize(m_mp->m_points.size() + 2);
-        //for (size_t i = 0; i < m_mp->m_points.size(); ++i) {
-        //    m_visGraph[i] = m_mp->m_visGraph[i];
-        //}
-    };
+    AStar::AStar(MilePath* mp) : m_mp(mp), m_path(this) {};
 
     class Path {
     public:
@@ -713,37 +1355,70 @@ namespace Pathing {
     };
     Path m_path;
 
-    void AStar::insertPointIntoVisGraph(MilePath::point& point)
-    {
-        auto& visGraph = m_mp->m_visGraph;
+    AStar::QueryOverlay::QueryOverlay(MilePath* mp, const MilePath::point& start, const MilePath::point& goal)
+        : m_mp(mp), m_start(start), m_goal(goal) {
+        const auto point_count = m_mp->m_points.size();
+        m_start.id = static_cast<MilePath::point::Id>(point_count);
+        m_goal.id = static_cast<MilePath::point::Id>(point_count + 1);
+        m_goalEdgeIndex.assign(point_count, no_edge);
+
         float sqrange = m_mp->m_visibility_range * m_mp->m_visibility_range;
         std::vector<const AABB *> open;
         std::vector<bool> visited;
-        for (auto it = m_mp->m_points.cbegin(); it != m_mp->m_points.cend(); ++it) {
-            float sqdistance = GetSquareDistance((*it).pos, point.pos);
-            if (sqdistance > sqrange)
-                continue;
+        for (const auto& p : m_mp->m_points) {
+            float sqdistance = GetSquareDistance(p.pos, m_start.pos);
+            if (sqdistance <= sqrange) {
+                std::vector<uint32_t> blocking_ids;
+                if (m_mp->HasLineOfSight(p, m_start, open, visited, &blocking_ids))
+                    m_startEdges.emplace_back( p.id, sqrtf(sqdistance), std::move(blocking_ids) );
+            }
 
-            std::vector<uint32_t> blocking_ids;
-            if (!m_mp->HasLineOfSight((*it), point, open, visited, &blocking_ids)) 
-                continue;
+            sqdistance = GetSquareDistance(p.pos, m_goal.pos);
+            if (sqdistance <= sqrange) {
+                std::vector<uint32_t> blocking_ids;
+                if (m_mp->HasLineOfSight(p, m_goal, open, visited, &blocking_ids)) {
+                    m_goalEdgeIndex[p.id] = static_cast<uint32_t>(m_goalEdges.size());
+                    m_goalEdges.emplace_back( m_goal.id, sqrtf(sqdistance), std::move(blocking_ids) );
+                }
+            }
+        }
 
-            float distance = sqrtf(sqdistance);
-            visGraph[point.id].emplace_back( (*it).id, distance, blocking_ids );
-            visGraph[(*it).id].emplace_back( point.id, distance, std::move(blocking_ids) );
+        const float sqdistance = GetSquareDistance(m_start.pos, m_goal.pos);
+        if (sqdistance <= sqrange) {
+            std::vector<uint32_t> blocking_ids;
+            if (m_mp->HasLineOfSight(m_start, m_goal, open, visited, &blocking_ids))
+                m_startEdges.emplace_back( m_goal.id, sqrtf(sqdistance), std::move(blocking_ids) );
         }
     }
 
+    const MilePath::point& AStar::QueryOverlay::point(MilePath::point::Id id) const {
+        if (id == m_start.id) return m_start;
+        if (id == m_goal.id) return m_goal;
+        return m_mp->m_points[id];
+    }
+
+    std::span<const MilePath::PointVisElement> AStar::QueryOverlay::edges(MilePath::point::Id id) const {
+        if (id == m_start.id) return m_startEdges;
+        if (id == m_goal.id) return {};
+        return m_mp->m_visGraph[id];
+    }
+
+    const MilePath::PointVisElement* AStar::QueryOverlay::goalEdge(MilePath::point::Id id) const {
+        if (static_cast<size_t>(id) >= m_goalEdgeIndex.size() || m_goalEdgeIndex[id] == no_edge)
+            return nullptr;
+        return &m_goalEdges[m_goalEdgeIndex[id]];
+    }
+
     //https://github.com/Rikora/A-star/blob/master/src/AStar.cpp
-    Error AStar::buildPath(const MilePath::point& start, const MilePath::point& goal,
-        std::vector<MilePath::point::Id>& came_from) {
-        MilePath::point current(goal);
+    Error AStar::buildPath(const QueryOverlay& overlay, std::vector<MilePath::point::Id>& came_from) {
+        const auto& start = overlay.start();
+        MilePath::point current(overlay.goal());
 
         m_path.clear();
 
-        int count = 0;
+        size_t count = 0;
         while (current.id != start.id) {
-            if (count++ > 64) {
+            if (count++ > overlay.size()) {
                 Log::Error("build path failed\n");
                 return Error::BuildPathLengthExceeded;
             }
@@ -754,88 +1429,43 @@ namespace Pathing {
             auto& id = came_from[current.id];
             if (id == start.id)
                 break;
-            current = m_mp->m_points[id];
+            current = overlay.point(id);
         }
         m_path.insertPoint(start);
         m_path.finalize();
         return Error::OK;
     }
 
-    float AStar::teleporterHeuristic(const MilePath::point& start, const MilePath::point& goal) {
-        if (!m_mp->m_teleports.size())
+    float AStar::teleporterHeuristic(const MilePath::point& point, float teleport_to_goal) {
+        //admissible: every route using a teleport first walks to an entrance, then costs at least teleport_to_goal.
+        const auto& entrance_distances = m_mp->m_teleportEntranceDistances;
+        if (point.id < 0 || static_cast<size_t>(point.id) >= entrance_distances.size())
             return 0.0f;
-        
-        using namespace MapSpecific;
+        return entrance_distances[point.id] + teleport_to_goal;
+    }
 
-        float cost = INFINITY;
-        const Teleport *ts = nullptr, *tg = nullptr;
-        float dist_start = cost, dist_goal = cost;
-        for (const auto &tp : m_mp->m_teleports) {
-            float dist = GetSquareDistance(start.pos, tp.m_enter);
-            if (tp.m_directionality == Teleport::direction::both_ways)
-                dist = std::min(dist, GetSquareDistance(start.pos, tp.m_exit));
-                
-            if (dist_start > dist) {
-                dist_start = dist;
-                ts = &tp;
-            }
+    Error AStar::search(const GamePos &start_pos, const GamePos &goal_pos, const std::vector<uint32_t> *blocks, bool heuristic) {
+        if (!m_mp->ready())
+            return Error::MilePathNotReady;
 
-            dist = GetSquareDistance(goal.pos, tp.m_exit);
-            if (tp.m_directionality == Teleport::direction::both_ways)
-                dist = std::min(dist, GetSquareDistance(goal.pos, tp.m_enter));
-                
-            if (dist_goal > dist) {
-                dist_goal = dist;
-                tg = &tp;
-            }
+        if (blocks) {
+            m_block = *blocks;
         }
-
-        for (const auto &ttd : m_mp->m_teleportGraph) {
-            if (ttd.tp1 == ts && ttd.tp2 == tg) {
-                //cost = sqrtf(dist_start) + ttd.distance + sqrtf(dist_goal);
-                cost = sqrtf(dist_start);
-                break;
-            }
+        else {
+            Pathing::Error res = CopyPathingMapBlocks(m_block);
+            if (res != Pathing::Error::OK)
+                return res;
         }
-        return cost;
-    }
-
-    Error AStar::search(const GamePos &start_pos, const GamePos &goal_pos) {
+        const auto& block = m_block;
+        m_path.clear();
 
-        std::lock_guard<std::mutex> lock(pathing_mutex);
+        MilePath::point start = m_mp->CreatePoint(start_pos);
+        if (!start.box)
+            return Error::FailedToFindStartBox;
 
-        std::vector<uint32_t> block;
-        Pathing::Error res = CopyPathingMapBlocks(block);
-
-        if (res != Pathing::Error::OK)
-            return res;
-        MilePath::point::Id point_id = m_mp->m_points.size();
-        MilePath::point start;
-        bool new_start = false;
-        m_path.clear();
-        //if (m_mp->m_pointLookup.contains(start_pos)) {
-        //    start = *m_mp->m_pointLookup.at(start_pos);
-        //} else 
-        {
-            start = m_mp->CreatePoint(start_pos);
-            if (!start.box)
-                return Error::FailedToFindStartBox;
-            start.id = point_id++;
-            new_start = true;
-        }
-
-        MilePath::point goal;
-        bool new_goal = false;
-        //if (m_mp->m_pointLookup.contains(goal_pos)) {
-        //    goal = *m_mp->m_pointLookup.at(goal_pos);
-        //} else 
-        {
-            goal = m_mp->CreatePoint(goal_pos);
-            if (!goal.box)
-                return Error::FailedToFindGoalBox;
-            goal.id = point_id++;
-            new_goal = true;
-        }
+        MilePath::point goal = m_mp->CreatePoint(goal_pos);
+        if (!goal.box)
+            return Error::FailedToFindGoalBox;
 
         {
             std::vector<const AABB *> open;
@@ -852,88 +1482,267 @@ namespace Pathing {
             }
         }
 
-        volatile clock_t start_timestamp = clock();
-
-        //@Cleanup: Maybe I'm not using milepath for its intended purpose, but this function will ALWAYS add more points to the graph!!
-        if (new_start) {
-            m_mp->m_points.push_back(start);
-            insertPointIntoVisGraph(start);
-        }
-        if (new_goal) {
-            m_mp->m_points.push_back(goal);
-            insertPointIntoVisGraph(goal);
-        }
+        //start and goal are connected to the graph through an overlay, the shared visibility graph is left untouched.
+        const QueryOverlay overlay(m_mp, start, goal);
+        start.id = overlay.start().id;
+        goal.id = overlay.goal().id;
 
         std::vector<float> cost_so_far;
         std::vector<MilePath::point::Id> came_from;
-        MyPQueue open(m_mp->m_points.size() + 2);
+        MyPQueue open(overlay.size());
 
-        cost_so_far.resize(m_mp->m_points.size() + 2, -INFINITY);
+        cost_so_far.resize(overlay.size(), -INFINITY);
         cost_so_far[start.id] = 0.0f;
         
-        came_from.resize(m_mp->m_points.size() + 2);
+        came_from.resize(overlay.size());
         came_from[start.id] = start.id;
         open.emplace(0.0f, start.id);
 
         bool teleports = m_mp->m_teleports.size();
+        const float teleport_to_goal = teleports ? m_mp->TeleportToGoalCost(goal.pos) : INFINITY;
         MilePath::point::Id current = 0; //-1
+        auto visit = [&](const MilePath::PointVisElement& vis) {
+            if (std::ranges::any_of(vis.blocking_ids, [&block](auto &id) { return block[id]; }))
+                return;
+
+            float new_cost = cost_so_far[current] + vis.distance;
+            if (cost_so_far[vis.point_id] == -INFINITY || new_cost < cost_so_far[vis.point_id]) {
+                cost_so_far[vis.point_id] = new_cost;
+                came_from[vis.point_id] = current;
+
+                float priority = new_cost;
+                if (heuristic) {
+                    auto &point = overlay.point(vis.point_id);
+                    float h = GetDistance(point.pos, goal.pos);
+                    if (teleports)
+                        h = std::min(h, teleporterHeuristic(point, teleport_to_goal));
+                    priority += h;
+                }
+                open.emplace(priority, vis.point_id);
+            }
+        };
         while (!open.empty()) {
             current = open.top().second;
             open.pop();
             if (current == goal.id)
                 break;
 
-            for (auto &vis : m_mp->m_visGraph[current]) {
-                if (std::ranges::any_of(vis.blocking_ids, [&block](auto &id) { return block[id]; }))
-                    continue;
+            for (auto &vis : overlay.edges(current)) {
+                visit(vis);
+            }
+            if (const auto *vis = overlay.goalEdge(current)) {
+                visit(*vis);
+            }
+        }
 
-                float new_cost = cost_so_far[current] + vis.distance;
-                if (cost_so_far[vis.point_id] == -INFINITY || new_cost < cost_so_far[vis.point_id]) {
-                    cost_so_far[vis.point_id] = new_cost;
-                    came_from[vis.point_id] = current;
+        if (current == goal.id) {
+            buildPath(overlay, came_from);
+            m_path.setCost(cost_so_far[current]);
+        }
 
-                    float priority = new_cost;
-                    if (teleports) {
-                        auto &point = m_mp->m_points[vis.point_id];
-                        float tp_cost = teleporterHeuristic(point, goal);
-                        priority += std::min(GetDistance(point.pos, goal.pos), tp_cost);
-                    }
-                    open.emplace(priority, vis.point_id);
+        m_path.finalize();
+        return m_path.ready() ? Error::OK : Error::FailedToFinializePath;
+    }
+
+    bool AStar::isVisible(const MilePath::point& from, const MilePath::point& to, const std::vector<uint32_t>& block) {
+        std::vector<uint32_t> blocking_ids;
+        if (!m_mp->HasLineOfSight(from, to, m_open, m_visited, &blocking_ids))
+            return false;
+        return !std::ranges::any_of(blocking_ids, [&block](auto& id) { return id < block.size() && block[id]; });
+    }
+
+    void AStar::buildGoalField(const MilePath::point& goal, const GamePos& goal_pos, const std::vector<uint32_t>& block) {
+        const auto& points = m_mp->m_points;
+        const auto& vis_graph = m_mp->m_visGraph;
+        const auto& reverse_graph = m_mp->m_reverseVisGraph;
+        const float sqrange = m_mp->m_visibility_range * m_mp->m_visibility_range;
+
+        m_field.goal_pos = goal_pos;
+        m_field.goal = goal;
+        m_field.goal.id = static_cast<MilePath::point::Id>(points.size());
+        m_field.block = block;
+        m_field.cost.assign(points.size(), INFINITY);
+        m_field.next.assign(points.size(), m_field.goal.id);
+
+        //dijkstra backwards from the goal
+        MyPQueue open(points.size());
+        for (const auto& p : points) {
+            const float sqdistance = GetSquareDistance(p.pos, goal.pos);
+            if (sqdistance > sqrange || !isVisible(p, goal, block))
+                continue;
+            m_field.cost[p.id] = sqrtf(sqdistance);
+            open.emplace(m_field.cost[p.id], p.id);
+        }
+        while (!open.empty()) {
+            const auto [cost, current] = open.top();
+            open.pop();
+            if (cost > m_field.cost[current])
+                continue; //stale entry
+            for (const auto& incoming : reverse_graph[current]) {
+                const auto& vis = vis_graph[incoming.point_id][incoming.index];
+                if (std::ranges::any_of(vis.blocking_ids, [&block](auto& id) { return id < block.size() && block[id]; }))
+                    continue;
+                const float new_cost = cost + vis.distance;
+                if (new_cost < m_field.cost[incoming.point_id]) {
+                    m_field.cost[incoming.point_id] = new_cost;
+                    m_field.next[incoming.point_id] = current;
+                    open.emplace(new_cost, incoming.point_id);
                 }
             }
         }
+        m_field.valid = true;
+    }
 
-        if (current == goal.id) {
-            buildPath(start, goal, came_from);
-            m_path.setCost(cost_so_far[current]);
+    Error AStar::buildFieldPath(const MilePath::point& start, MilePath::point::Id point_id, float cost) {
+        std::vector<MilePath::point> points = { start };
+        for (auto id = point_id; id != m_field.goal.id; id = m_field.next[id]) {
+            if (points.size() > m_field.cost.size()) {
+                Log::Error("build path failed\n");
+                return Error::BuildPathLengthExceeded;
+            }
+            points.push_back(m_mp->m_points[id]);
         }
+        points.push_back(m_field.goal);
 
-        //TODO: Implement a pop list so there is no need to search every node?
-        if (new_goal) {
-            auto &other_elements = m_mp->m_visGraph[goal.id];
-            
-            for (auto &elem : other_elements) {
-                auto &points = m_mp->m_visGraph[elem.point_id];
-                std::erase_if(points, [&goal](auto &elem) { return elem.point_id == goal.id; });
+        m_path.clear();
+        for (auto it = points.rbegin(); it != points.rend(); ++it) {
+            m_path.insertPoint(*it);
+        }
+        m_path.setCost(cost);
+        m_path.finalize();
+        return Error::OK;
+    }
+
+    Error AStar::replan(const GamePos& start_pos, const GamePos& goal_pos, const std::vector<uint32_t>* block) {
+        if (!m_mp->ready())
+            return Error::MilePathNotReady;
+
+        std::vector<uint32_t> copied_block;
+        if (!block) {
+            const auto res = CopyPathingMapBlocks(copied_block);
+            if (res != Error::OK)
+                return res;
+            block = &copied_block;
+        }
+        m_block = *block;
+
+        MilePath::point start = m_mp->CreatePoint(start_pos);
+        if (!start.box)
+            return Error::FailedToFindStartBox;
+        start.id = -1;
+
+        if (!(m_field.valid && m_field.goal_pos == goal_pos && m_field.block == *block)) {
+            MilePath::point goal = m_mp->CreatePoint(goal_pos);
+            if (!goal.box)
+                return Error::FailedToFindGoalBox;
+            buildGoalField(goal, goal_pos, *block);
+            m_path.clear();
+        }
+        const auto& goal = m_field.goal;
+
+        if (isVisible(start, goal, *block)) {
+            m_path.clear();
+            m_path.insertPoint(start);
+            m_path.insertPoint(goal);
+            m_path.setCost(GetDistance(start.pos, goal.pos));
+            m_path.finalize();
+            return Error::OK;
+        }
+
+        //still near the previous path: join it at the furthest waypoint in sight.
+        const float sqrange = m_mp->m_visibility_range * m_mp->m_visibility_range;
+        if (m_path.ready()) {
+            const auto& points = m_path.points();
+            for (auto it = points.rbegin(); it != points.rend(); ++it) {
+                const auto& p = *it;
+                if (p.id < 0 || static_cast<size_t>(p.id) >= m_field.cost.size())
+                    continue; //old start or the goal
+                if (GetSquareDistance(p.pos, start.pos) > sqrange || !isVisible(start, p, *block))
+                    continue;
+                return buildFieldPath(start, p.id, GetDistance(start.pos, p.pos) + m_field.cost[p.id]);
             }
-            m_mp->m_points.pop_back();
-            m_mp->m_visGraph[goal.id].clear();
         }
-        if (new_start) {
-            auto &other_elements = m_mp->m_visGraph[start.id];
-            
-            for (auto &elem : other_elements) {
-                auto &points = m_mp->m_visGraph[elem.point_id];
-                std::erase_if(points, [&start](auto &elem) { return elem.point_id == start.id; });
+
+        //otherwise connect to the whole graph
+        float best_cost = INFINITY;
+        MilePath::point::Id best = -1;
+        for (const auto& p : m_mp->m_points) {
+            if (m_field.cost[p.id] == INFINITY)
+                continue;
+            const float sqdistance = GetSquareDistance(p.pos, start.pos);
+            if (sqdistance > sqrange)
+                continue;
+            const float cost = sqrtf(sqdistance) + m_field.cost[p.id];
+            if (cost >= best_cost || !isVisible(start, p, *block))
+                continue;
+            best_cost = cost;
+            best = p.id;
+        }
+        if (best < 0) {
+            m_path.clear();
+            return Error::FailedToFinializePath;
+        }
+        return buildFieldPath(start, best, best_cost);
+    }
+
+    float AStar::segmentCost(const MilePath::point& from, const MilePath::point& to) const {
+        //teleports are cheaper than walking the distance between their ends. The ends of a teleport in sight of
+        //each other also have a walking edge, so take the cheapest.
+        float cost = GetDistance(from.pos, to.pos);
+        if (from.id >= 0 && static_cast<size_t>(from.id) < m_mp->m_visGraph.size()) {
+            for (const auto& vis : m_mp->m_visGraph[from.id]) {
+                if (vis.point_id == to.id)
+                    cost = std::min(cost, vis.distance);
+            }
+        }
+        return cost;
+    }
+
+    bool AStar::isTeleportEdge(const MilePath::point& from, const MilePath::point& to) const {
+        return segmentCost(from, to) < GetDistance(from.pos, to.pos);
+    }
+
+    void AStar::smoothPath() {
+        if (!m_path.ready())
+            return;
+        const auto& points = m_path.points();
+        if (points.size() < 3)
+            return;
+
+        //a teleport can't be replaced by walking: both its ends are kept and nothing is smoothed across it.
+        std::vector<bool> teleport(points.size() - 1);
+        for (size_t i = 0; i + 1 < points.size(); ++i) {
+            teleport[i] = isTeleportEdge(points[i], points[i + 1]);
+        }
+
+        std::vector<MilePath::point> smoothed = { points.front() };
+        float cost = 0.0f;
+        size_t anchor = 0;
+        while (anchor < points.size() - 1) {
+            //furthest point we may skip to: the entrance of the next teleport, or the end of the path
+            size_t limit = anchor + 1;
+            if (!teleport[anchor]) {
+                while (limit < points.size() - 1 && !teleport[limit])
+                    ++limit;
+            }
+            size_t next = anchor + 1;
+            for (size_t i = limit; i > anchor + 1; --i) {
+                if (isVisible(points[anchor], points[i], m_block)) {
+                    next = i;
+                    break;
+                }
             }
-            m_mp->m_points.pop_back();
-            m_mp->m_visGraph[start.id].clear();
+            cost += segmentCost(points[anchor], points[next]);
+            smoothed.push_back(points[next]);
+            anchor = next;
         }
 
-        volatile clock_t stop_timestamp = clock();
-        Log::Info("Find path: %d ms\n", stop_timestamp - start_timestamp);
+        m_path.clear();
+        for (auto it = smoothed.rbegin(); it != smoothed.rend(); ++it) {
+            m_path.insertPoint(*it);
+        }
+        m_path.setCost(cost);
         m_path.finalize();
-        return m_path.ready() ? Error::OK : Error::FailedToFinializePath;
     }
 
     GamePos AStar::getClosestPoint(const Vec2f& pos) {
@@ -981,4 +1790,311 @@ namespace Pathing {
         }
         return { pq[min_idx].point.pos.x, pq[min_idx].point.pos.y, pq[min_idx].point.box->m_t->layer };
     }
+
+    Error PathingDump::Capture(PathingDump& out) {
+        return ToolboxUtils::RunOnGameThread([&out] {
+            PathingMapArray* map = Map::GetPathingMap();
+            MapContext* mapContext = GW::GetMapContext();
+            if (!map || !mapContext || !mapContext->sub1)
+                return Error::InvalidMapContext;
+
+            out.map_id = Map::GetMapID();
+            out.teleports = MapSpecific::MapSpecificData(out.map_id).m_teleports;
+            out.trapezoids.clear();
+            for (uint32_t i = 0; i < map->size(); ++i) {
+                auto& m = (*map)[i];
+                for (uint32_t j = 0; j < m.trapezoid_count; j++) {
+                    const PathingTrapezoid& t = m.trapezoids[j];
+                    if (t.YB == t.YT) continue;
+                    out.trapezoids.emplace_back(t, i).SampleAltitudes();
+                }
+            }
+            const auto& block = mapContext->sub1->pathing_map_block;
+            out.block.assign(block.m_buffer, block.m_buffer + block.m_size);
+            return Error::OK;
+        }).value_or(Error::InvalidMapContext);
+    }
+
+    bool PathingDump::Save(const std::filesystem::path& path) const {
+        std::vector<DumpedTrapezoid> dumped_trapezoids;
+        dumped_trapezoids.reserve(trapezoids.size());
+        for (const auto& t : trapezoids) {
+            dumped_trapezoids.emplace_back(t.id, t.layer, t.a, t.b, t.c, t.d, t.alt_a, t.alt_b, t.alt_c, t.alt_d);
+        }
+        std::vector<DumpedTeleport> dumped_teleports;
+        dumped_teleports.reserve(teleports.size());
+        for (const auto& tp : teleports) {
+            dumped_teleports.emplace_back(tp.m_enter, tp.m_exit, static_cast<uint32_t>(tp.m_directionality));
+        }
+        const DumpHeader header = {
+            dump_magic, dump_version, static_cast<uint32_t>(map_id), static_cast<uint32_t>(dumped_trapezoids.size()),
+            static_cast<uint32_t>(block.size()), static_cast<uint32_t>(dumped_teleports.size())
+        };
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            Log::Error("Failed to open pathing dump %ls\n", path.c_str());
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        WriteArray(out, dumped_trapezoids);
+        WriteArray(out, block);
+        WriteArray(out, dumped_teleports);
+        if (!out.good()) {
+            Log::Error("Failed to write pathing dump %ls\n", path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool PathingDump::Load(const std::filesystem::path& path, PathingDump& out) {
+        const MappedFile file(path);
+        auto data = file.data();
+
+        std::span<const DumpHeader> header;
+        if (!ReadArray(data, 1, header) || header.front().magic != dump_magic || header.front().version != dump_version) {
+            Log::Error("Not a pathing dump: %ls\n", path.c_str());
+            return false;
+        }
+        const auto& h = header.front();
+        std::span<const DumpedTrapezoid> dumped_trapezoids;
+        std::span<const uint32_t> block;
+        std::span<const DumpedTeleport> dumped_teleports;
+        if (!(ReadArray(data, h.trapezoid_count, dumped_trapezoids)
+            && ReadArray(data, h.block_count, block)
+            && ReadArray(data, h.teleport_count, dumped_teleports))) {
+            Log::Error("Pathing dump truncated: %ls\n", path.c_str());
+            return false;
+        }
+
+        out.map_id = static_cast<Constants::MapID>(h.map_id);
+        out.trapezoids.clear();
+        out.trapezoids.reserve(dumped_trapezoids.size());
+        for (const auto& dumped : dumped_trapezoids) {
+            PathingTrapezoid t{};
+            t.id = dumped.id;
+            t.XTL = dumped.a.x;
+            t.XTR = dumped.d.x;
+            t.YT = dumped.a.y;
+            t.XBL = dumped.b.x;
+            t.XBR = dumped.c.x;
+            t.YB = dumped.b.y;
+            auto& pt = out.trapezoids.emplace_back(t, dumped.layer);
+            pt.alt_a = dumped.alt_a;
+            pt.alt_b = dumped.alt_b;
+            pt.alt_c = dumped.alt_c;
+            pt.alt_d = dumped.alt_d;
+        }
+        out.block.assign(block.begin(), block.end());
+        out.teleports.clear();
+        for (const auto& tp : dumped_teleports) {
+            out.teleports.emplace_back(tp.enter, tp.exit, static_cast<MapSpecific::Teleport::direction>(tp.directionality));
+        }
+        return true;
+    }
+
+    //The search as it was before QueryOverlay: start and goal are pushed into the graph itself and taken out again
+    //afterwards, then a plain Dijkstra runs over it. Benchmark runs it on a graph of its own, so it shares neither the
+    //graph nor the search code with AStar::search. Mutates mp, only use it on a graph no one else is searching.
+    static std::optional<float> ReferenceCost(MilePath& mp, const GamePos& start_pos, const GamePos& goal_pos, const std::vector<uint32_t>& block) {
+        auto blocked = [&block](const std::vector<uint32_t>& blocking_ids) {
+            return std::ranges::any_of(blocking_ids, [&block](auto& id) { return id < block.size() && block[id]; });
+        };
+
+        MilePath::point start = mp.CreatePoint(start_pos);
+        MilePath::point goal = mp.CreatePoint(goal_pos);
+        if (!start.box || !goal.box)
+            return std::nullopt;
+
+        std::vector<const AABB *> open_boxes;
+        std::vector<bool> visited;
+        {
+            std::vector<uint32_t> blocking_ids;
+            if (mp.HasLineOfSight(start, goal, open_boxes, visited, &blocking_ids) && !blocked(blocking_ids))
+                return GetDistance(start_pos, goal_pos);
+        }
+
+        const size_t point_count = mp.m_points.size();
+        const size_t graph_size = mp.m_visGraph.size();
+        mp.m_visGraph.resize(std::max(graph_size, point_count + 2));
+        const float sqrange = mp.m_visibility_range * mp.m_visibility_range;
+        auto insert = [&](MilePath::point& point) {
+            point.id = static_cast<MilePath::point::Id>(mp.m_points.size());
+            for (const auto& p : mp.m_points) {
+                const float sqdistance = GetSquareDistance(p.pos, point.pos);
+                if (sqdistance > sqrange)
+                    continue;
+                std::vector<uint32_t> blocking_ids;
+                if (!mp.HasLineOfSight(p, point, open_boxes, visited, &blocking_ids))
+                    continue;
+                const float distance = sqrtf(sqdistance);
+                mp.m_visGraph[point.id].emplace_back(p.id, distance, blocking_ids);
+                mp.m_visGraph[p.id].emplace_back(point.id, distance, std::move(blocking_ids));
+            }
+            mp.m_points.push_back(point);
+        };
+        insert(start);
+        insert(goal);
+
+        std::vector<float> cost(mp.m_points.size(), INFINITY);
+        MyPQueue open(mp.m_points.size());
+        cost[start.id] = 0.0f;
+        open.emplace(0.0f, start.id);
+        while (!open.empty()) {
+            const auto [current_cost, current] = open.top();
+            open.pop();
+            if (current == goal.id)
+                break;
+            if (current_cost > cost[current])
+                continue;
+            for (const auto& vis : mp.m_visGraph[current]) {
+                if (blocked(vis.blocking_ids))
+                    continue;
+                const float new_cost = current_cost + vis.distance;
+                if (new_cost < cost[vis.point_id]) {
+                    cost[vis.point_id] = new_cost;
+                    open.emplace(new_cost, vis.point_id);
+                }
+            }
+        }
+        const float goal_cost = cost[goal.id];
+
+        for (const auto* point : { &goal, &start }) {
+            for (const auto& vis : mp.m_visGraph[point->id]) {
+                std::erase_if(mp.m_visGraph[vis.point_id], [point](auto& elem) { return elem.point_id == point->id; });
+            }
+            mp.m_visGraph[point->id].clear();
+        }
+        mp.m_points.resize(point_count);
+        mp.m_visGraph.resize(graph_size);
+
+        if (goal_cost == INFINITY)
+            return std::nullopt;
+        return goal_cost;
+    }
+
+    BenchmarkResult Benchmark(const PathingDump& dump, bool reflex_points_only, size_t query_count, uint32_t seed) {
+        BenchmarkResult result;
+        auto wait_ready = [](MilePath& graph) {
+            while (!graph.ready()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        };
+        MilePath mp(dump, reflex_points_only);
+        wait_ready(mp);
+        result.stats = mp.stats();
+        if (dump.trapezoids.empty())
+            return result;
+
+        //the coarse test GenerateAABBGraph ran on every pair of boxes before the sweep, for comparison.
+        const auto all_pairs_start = std::chrono::steady_clock::now();
+        size_t all_pairs_candidates = 0;
+        for (size_t i = 0; i < mp.m_aabbs.size(); ++i) {
+            for (size_t j = i + 1; j < mp.m_aabbs.size(); ++j) {
+                if (mp.m_aabbs[i].intersect(mp.m_aabbs[j], { 1.0f, 1.0f }))
+                    all_pairs_candidates++;
+            }
+        }
+        result.all_pairs_broad_phase_time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - all_pairs_start).count();
+        Log::Info("Broad phase: sweep %.2f ms, all pairs %.2f ms (%d candidates), %d boxes\n",
+            result.stats.broad_phase_time, result.all_pairs_broad_phase_time, all_pairs_candidates, mp.m_aabbs.size());
+
+        //every point and no limit on edge length: the true shortest paths, whatever the graph under test leaves out.
+        MilePath full(dump, false, INFINITY);
+        wait_ready(full);
+
+        //uniformly random trapezoid, then a random point inside of it.
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<size_t> pick_trapezoid(0, dump.trapezoids.size() - 1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        auto random_pos = [&] {
+            const auto& t = dump.trapezoids[pick_trapezoid(rng)];
+            const float v = unit(rng);
+            const Vec2f left = t.b + (t.a - t.b) * v;
+            const Vec2f right = t.c + (t.d - t.c) * v;
+            const Vec2f p = left + (right - left) * unit(rng);
+            return GamePos(p.x, p.y, t.layer);
+        };
+        auto elapsed_ms = [](auto since) {
+            return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - since).count();
+        };
+
+        std::vector<float> latencies;
+        latencies.reserve(query_count);
+        std::vector<std::pair<GamePos, GamePos>> queries;
+        queries.reserve(query_count);
+        std::vector<float> costs; // -1 if no path was found
+        costs.reserve(query_count);
+        float reference_total = 0.0f;
+        AStar astar(&mp);
+        for (size_t i = 0; i < query_count; ++i) {
+            const GamePos start = random_pos();
+            const GamePos goal = random_pos();
+            queries.emplace_back(start, goal);
+
+            auto t0 = std::chrono::steady_clock::now();
+            const auto res = astar.search(start, goal, &dump.block);
+            latencies.push_back(elapsed_ms(t0));
+
+            t0 = std::chrono::steady_clock::now();
+            const auto ref_cost = ReferenceCost(full, start, goal, dump.block);
+            reference_total += elapsed_ms(t0);
+
+            const bool found = res == Error::OK && !astar.m_path.points().empty();
+            costs.push_back(found ? astar.m_path.cost() : -1.0f);
+            if (found)
+                result.paths_found++;
+            //costs are sums of floats added up in a different order, so allow a little slack.
+            if (found != ref_cost.has_value() || (found && fabsf(astar.m_path.cost() - *ref_cost) > 0.01f * std::max(1.0f, *ref_cost)))
+                result.mismatches++;
+        }
+
+        //the same queries again from several threads at once, each with its own AStar on the shared graph; that's
+        //what QueryOverlay is for. Every search has to come up with exactly the cost it had on its own.
+        const auto hardware_threads = std::thread::hardware_concurrency();
+        result.threads = std::max(hardware_threads, 2u);
+        std::atomic<size_t> next_query = 0;
+        std::atomic<size_t> concurrent_mismatches = 0;
+        auto worker = [&] {
+            AStar thread_astar(&mp);
+            for (size_t i = next_query++; i < query_count; i = next_query++) {
+                const auto& [start, goal] = queries[i];
+                const auto res = thread_astar.search(start, goal, &dump.block);
+                const bool found = res == Error::OK && !thread_astar.m_path.points().empty();
+                if ((found ? thread_astar.m_path.cost() : -1.0f) != costs[i])
+                    concurrent_mismatches++;
+            }
+        };
+        const auto concurrent_start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        threads.reserve(result.threads - 1);
+        for (size_t i = 1; i < result.threads; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        const float concurrent_ms = elapsed_ms(concurrent_start);
+        result.concurrent_mismatches = concurrent_mismatches;
+
+        result.queries = query_count;
+        if (!latencies.empty()) {
+            float search_total = 0.0f;
+            for (const auto latency : latencies)
+                search_total += latency;
+            if (search_total > 0.0f)
+                result.qps = static_cast<float>(query_count) * 1000.0f / search_total;
+            if (concurrent_ms > 0.0f)
+                result.concurrent_qps = static_cast<float>(query_count) * 1000.0f / concurrent_ms;
+            std::ranges::sort(latencies);
+            auto percentile = [&latencies](float p) { return latencies[static_cast<size_t>(p * static_cast<float>(latencies.size() - 1))]; };
+            result.p50 = percentile(0.5f);
+            result.p90 = percentile(0.9f);
+            result.p99 = percentile(0.99f);
+            result.max = latencies.back();
+            result.reference_avg = reference_total / static_cast<float>(latencies.size());
+        }
+        return result;
+    }
 }
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <filesystem>
+#include <span>
 #include <GWCA/GameContainers/GamePos.h>
 #include <GWCA/GameEntities/Pathing.h>
 #include "MapSpecificData.h"
@@ -15,7 +18,8 @@ namespace Pathing {
         FailedToFinializePath,
         InvalidMapContext,
         BuildPathLengthExceeded,
-        FailedToGetPathingMapBlock
+        FailedToGetPathingMapBlock,
+        MilePathNotReady
     };
 
 
@@ -31,10 +35,14 @@ namespace Pathing {
 
         SimplePT(const GW::PathingTrapezoid &pt, uint32_t layer);
         adjacentSide Touching(const SimplePT &rhs) const;
+        //Uses the altitudes cached by SampleAltitudes(); both trapezoids must have been sampled.
         adjacentSide TouchingHeight(const SimplePT &rhs, float max_height_diff = 200.0f) const;
+        //Queries the gw client for the height of each corner. Must be called on the game thread.
+        void SampleAltitudes();
 
         uint32_t id, layer;
         GW::Vec2f a, b, c, d;
+        float alt_a = 0.0f, alt_b = 0.0f, alt_c = 0.0f, alt_d = 0.0f;
         const bool IsOnPathingTrapezoid(const GW::Vec2f& p) const;
     };
 
@@ -54,6 +62,40 @@ namespace Pathing {
         const SimplePT *m_t;
     };
 
+    // Uniform grid over a set of AABBs for point queries.
+    // Each cell holds the boxes overlapping it, in the order they were given to build().
+    class AABBGrid {
+    public:
+        void build(const std::vector<AABB> &aabbs);
+        void clear();
+
+        // Boxes that may contain p; empty if p is outside of the grid.
+        std::span<const AABB* const> query(const GW::Vec2f &p) const;
+
+    private:
+        void cellCoords(float x, float y, uint32_t &cx, uint32_t &cy) const;
+
+        GW::Vec2f m_min = {};
+        float m_invCellSize = 0.0f;
+        uint32_t m_width = 0, m_height = 0;
+        std::vector<uint32_t> m_cellStart; // [cell] offset into m_items, m_width * m_height + 1 entries
+        std::vector<const AABB*> m_items;
+    };
+
+    // Everything MilePath reads from the game for one map, so graphs can be built and searched without the client.
+    // Dumps are meant for benchmarking and checking pathing changes against real maps.
+    struct PathingDump {
+        GW::Constants::MapID map_id = GW::Constants::MapID::None;
+        std::vector<SimplePT> trapezoids; // with sampled altitudes
+        std::vector<uint32_t> block; // pathing_map_block
+        MapSpecific::Teleports teleports;
+
+        // Copies the current map on the game thread; blocks until it's done, so don't call it from the game thread.
+        static Error Capture(PathingDump &out);
+        bool Save(const std::filesystem::path &path) const;
+        static bool Load(const std::filesystem::path &path, PathingDump &out);
+    };
+
     class MilePath {
     private:
 
@@ -62,12 +104,30 @@ namespace Pathing {
         volatile bool m_processing = false;
         volatile bool m_done = false;
         volatile bool m_terminateThread = false;
-        volatile int m_progress = 0;
+        std::atomic<int> m_progress = 0; // written by every thread generating the visibility graph
 
         std::thread* worker_thread = nullptr;
         
     public:
-        MilePath();
+        struct Stats {
+            size_t point_count = 0;
+            size_t edge_count = 0; // directed edges in m_visGraph
+            clock_t build_time = 0; // ms
+            // ms spent building the AABBs and finding the ones that may touch, before the worker thread takes over;
+            // on the game thread for the current map, where it should stay under 10 ms. Without the sweep when loaded from cache.
+            float broad_phase_time = 0.0f;
+            size_t memory_usage = 0; // bytes held by the graph, roughly
+            bool loaded_from_cache = false;
+        };
+
+        // reflex_points_only: only use portal endpoints at reflex corners of the walkable area as visibility graph nodes.
+        // Shortest paths only bend at those corners, so the graph gets a lot smaller without losing optimal paths;
+        // edges are no longer limited to m_visibility_range, since that relied on the points in between.
+        // cache_folder: if not empty, the finished graph is saved in this folder and loaded from there on the next visit.
+        MilePath(bool reflex_points_only = false, const std::filesystem::path& cache_folder = {});
+        // Builds the graph from a dump instead of the current map; doesn't touch the game, so it works anywhere.
+        // visibility_range: see m_visibility_range; ignored with reflex_points_only.
+        MilePath(const PathingDump& dump, bool reflex_points_only = false, float visibility_range = 5000);
         ~MilePath();
 
         MilePath* instance();
@@ -90,6 +150,10 @@ namespace Pathing {
         bool ready() {
             return m_progress >= 100;
         }
+        // Valid once ready()
+        const Stats& stats() const {
+            return m_stats;
+        }
 
         MapSpecific::MapSpecificData m_msd;
 
@@ -124,8 +188,11 @@ namespace Pathing {
             std::vector<uint32_t> blocking_ids; //Holds all layer changes; for checking if it's passable or blocked.
         } PointVisElement;
         
+        // Longest edge in the visibility graph. Unlimited with reflex_points_only: without the points in between,
+        // corners further apart than this would lose their only connection.
         float m_visibility_range = 5000;
         std::vector<AABB> m_aabbs;
+        AABBGrid m_aabbGrid;
         std::vector<SimplePT> m_trapezoids;
         std::vector<std::vector<PointVisElement>> m_visGraph; // [point.id]
         std::vector<std::vector<const AABB*>> m_AABBgraph; // [box.id]
@@ -134,9 +201,26 @@ namespace Pathing {
         std::vector<point> m_points; // [point.id]
         MapSpecific::Teleports m_teleports;
         std::vector<MapSpecific::teleport_node> m_teleportGraph;
+        // [from * 2 * m_teleports.size() + to] lower bound for travelling between teleport endpoints,
+        // endpoint 2 * i is the enter and 2 * i + 1 the exit of m_teleports[i].
+        std::vector<float> m_teleportDistances;
+        // [point.id] distance to the closest teleport endpoint that can be entered
+        std::vector<float> m_teleportEntranceDistances;
+
+        struct IncomingVisElement {
+            point::Id point_id; // other point
+            uint32_t index; // into m_visGraph[point_id]
+        };
+        std::vector<std::vector<IncomingVisElement>> m_reverseVisGraph; // [point.id], used for backwards searches
 
         //Generate distance graph among teleports
         void GenerateTeleportGraph();
+        //Floyd-Warshall over teleport endpoints and nearest entrance per point, used by AStar::teleporterHeuristic.
+        void GenerateTeleportHeuristic();
+        //Lower bound for the cost from any teleport entrance to pos. INFINITY if the map has no teleports.
+        float TeleportToGoalCost(const GW::Vec2f &pos) const;
+        //Incoming edges of every point, used by AStar::replan.
+        void GenerateReverseVisibilityGraph();
         MilePath::point CreatePoint(const GW::GamePos &pos);
 
         bool HasLineOfSight(const point &start, const point &goal,
@@ -147,16 +231,44 @@ namespace Pathing {
         bool IsOnPathingTrapezoid(const GW::Vec2f &p, const SimplePT **pt = nullptr);
 
     private:
-        void LoadMapSpecificData();
+        bool m_reflexPointsOnly = false;
+        Stats m_stats;
+        GW::Constants::MapID m_mapId = GW::Constants::MapID::None;
+        uint64_t m_mapHash = 0; // Hash of the pathing map and teleports the graph is built from
+        std::filesystem::path m_cacheFile;
 
-        //Generate Axis Aligned Bounding Boxes around trapezoids
+        void LoadMapSpecificData();
+        // Runs the rest of the build on the worker thread
+        // use_cache: IsCacheCurrent() was true, so candidates were skipped
+        void StartProcessing(std::vector<std::pair<AABB::boxId, AABB::boxId>> &&candidates, bool use_cache, clock_t start);
+        size_t MemoryUsage() const;
+
+        uint64_t ComputeMapHash() const;
+        // Loads portals, points and visibility graph saved by SaveCache. False if missing, outdated or corrupt.
+        bool LoadCache();
+        // True if m_cacheFile exists and its header matches this map. Only reads the header.
+        bool IsCacheCurrent() const;
+        bool SaveCache() const;
+
+        //Copies the trapezoids of the current map into m_trapezoids.
+        void LoadTrapezoids();
+
+        //Generate Axis Aligned Bounding Boxes around m_trapezoids
         //This is used for quick intersection checks.
         void GenerateAABBs();
 
         bool CreatePortal(const AABB *box1, const AABB *box2, const SimplePT::adjacentSide &ts);
 
+        //Sweep and prune broad phase; pairs of m_aabbs indices (i < j) whose boxes may touch, in ascending order.
+        //sample_altitudes: also samples altitudes of trapezoids on different layers that may touch;
+        //must be called on the game thread then.
+        std::vector<std::pair<AABB::boxId, AABB::boxId>> FindAdjacentCandidates(bool sample_altitudes = true);
+
         //Connect trapezoid AABBS.
-        void GenerateAABBGraph();
+        void GenerateAABBGraph(const std::vector<std::pair<AABB::boxId, AABB::boxId>> &candidates);
+
+        //True if the point sits on a reflex corner of the walkable area, or on a layer change.
+        bool IsReflexPoint(const point &p) const;
 
         void GeneratePoints();
 
@@ -208,23 +320,107 @@ namespace Pathing {
             float m_cost; //distance
         };
 		
+        // Start and goal points of a single search, connected to the visibility graph of a MilePath
+        // without modifying it, so any number of searches can run on the same MilePath at once.
+        // Start and goal get the ids following the last point of the MilePath.
+        class QueryOverlay {
+        public:
+            QueryOverlay(MilePath *mp, const MilePath::point &start, const MilePath::point &goal);
+
+            const MilePath::point &start() const { return m_start; }
+            const MilePath::point &goal() const { return m_goal; }
+            // Number of points including start and goal
+            size_t size() const { return m_mp->m_points.size() + 2; }
+
+            const MilePath::point &point(MilePath::point::Id id) const;
+            // Outgoing edges of a point, except for the one into the goal; see goalEdge()
+            std::span<const MilePath::PointVisElement> edges(MilePath::point::Id id) const;
+            // Edge from a point into the goal, nullptr if the goal isn't visible from it
+            const MilePath::PointVisElement *goalEdge(MilePath::point::Id id) const;
+
+        private:
+            static constexpr uint32_t no_edge = 0xFFFFFFFF;
+
+            MilePath *m_mp;
+            MilePath::point m_start, m_goal;
+            std::vector<MilePath::PointVisElement> m_startEdges; // start -> point
+            std::vector<MilePath::PointVisElement> m_goalEdges; // point -> goal
+            std::vector<uint32_t> m_goalEdgeIndex; // [point.id] index into m_goalEdges
+        };
+
         Path m_path;
 
         AStar(MilePath *mp);
 
-        void insertPointIntoVisGraph(MilePath::point &point);
-        
-        Error buildPath(const MilePath::point &start, const MilePath::point &goal, std::vector<MilePath::point::Id> &came_from);
+        Error buildPath(const QueryOverlay &overlay, std::vector<MilePath::point::Id> &came_from);
 
-        inline float teleporterHeuristic(const MilePath::point &start, const MilePath::point &goal);
+        //Lower bound for reaching the goal from point when teleports may be used. O(1).
+        //teleport_to_goal: MilePath::TeleportToGoalCost for the goal of the search.
+        inline float teleporterHeuristic(const MilePath::point &point, float teleport_to_goal);
 
-        Error search(const GW::GamePos &start_pos, const GW::GamePos &goal_pos);
+        // block: pathing map blocks to use; copied from the game thread if nullptr.
+        // heuristic: false runs a plain Dijkstra; much slower, only useful as a reference for checking results.
+        Error search(const GW::GamePos &start_pos, const GW::GamePos &goal_pos,
+            const std::vector<uint32_t> *block = nullptr, bool heuristic = true);
+
+        // Incremental version of search() for a goal that stays put while the start moves, e.g. the player walking.
+        // The first call searches backwards from the goal over the whole graph and keeps the cost to the goal of every
+        // point. Later calls only have to connect the start to the previous path, or to the graph if it wandered off,
+        // which is cheap enough to do every frame. The costs are recomputed when the goal moves or a layer is (un)blocked.
+        // block: pathing map blocks to use; copied from the game thread if nullptr, so pass them in when on the game thread.
+        // m_path is kept as it was if the start isn't on the pathing map, so a short step off the map doesn't lose it.
+        Error replan(const GW::GamePos &start_pos, const GW::GamePos &goal_pos, const std::vector<uint32_t> *block = nullptr);
+
+        // String pulling: skips every waypoint that can be bypassed by walking straight to a later one.
+        // Teleports are kept as they are, and no waypoint is skipped across one.
+        void smoothPath();
 
         GW::GamePos getClosestPoint(const GW::Vec2f &pos);
         GW::GamePos getClosestPoint(Path &path, const GW::Vec2f &pos);
 
     private:
-        std::vector<std::vector<MilePath::PointVisElement>> m_visGraph;
+        // Cost to the goal of every point, see replan()
+        struct GoalField {
+            bool valid = false;
+            GW::GamePos goal_pos;
+            MilePath::point goal;
+            std::vector<uint32_t> block;
+            std::vector<float> cost; // [point.id], INFINITY if the goal can't be reached
+            std::vector<MilePath::point::Id> next; // [point.id] next point towards the goal
+        };
+
+        void buildGoalField(const MilePath::point &goal, const GW::GamePos &goal_pos, const std::vector<uint32_t> &block);
+        // Sets m_path to start, then point_id and the points after it in m_field
+        Error buildFieldPath(const MilePath::point &start, MilePath::point::Id point_id, float cost);
+        bool isVisible(const MilePath::point &from, const MilePath::point &to, const std::vector<uint32_t> &block);
+        float segmentCost(const MilePath::point &from, const MilePath::point &to) const;
+        // True if going from -> to takes a teleport rather than walking
+        bool isTeleportEdge(const MilePath::point &from, const MilePath::point &to) const;
+
         MilePath* m_mp;
+        GoalField m_field;
+        std::vector<uint32_t> m_block; // blocks used for the last search
+        std::vector<const AABB *> m_open; // scratch buffers for line of sight checks
+        std::vector<bool> m_visited;
+    };
+
+    struct BenchmarkResult {
+        MilePath::Stats stats;
+        size_t queries = 0;
+        size_t paths_found = 0;
+        size_t mismatches = 0; // searches whose cost differs from the shortest path found by the reference
+        float p50 = 0.0f, p90 = 0.0f, p99 = 0.0f, max = 0.0f; // search latency, ms
+        float reference_avg = 0.0f; // reference search latency, ms
+        float all_pairs_broad_phase_time = 0.0f; // ms for the coarse test on every pair of boxes, what the sweep replaced
+        float qps = 0.0f; // searches per second on one thread
+        size_t threads = 0; // searching the same graph at once in the concurrent run
+        float concurrent_qps = 0.0f; // searches per second over all threads
+        size_t concurrent_mismatches = 0; // concurrent searches whose cost differs from the same search run alone
     };
+
+    // Builds the graph for dump and runs query_count searches between random points on the map. Each is checked against
+    // the old search that inserts start and goal into the graph, run as a plain Dijkstra over a second graph of every
+    // point with no limit on edge length, so it finds the true shortest path. The queries are then run again from a thread
+    // per core at once to measure throughput. Blocking; takes a while on big maps.
+    BenchmarkResult Benchmark(const PathingDump &dump, bool reflex_points_only, size_t query_count, uint32_t seed = 1);
 }
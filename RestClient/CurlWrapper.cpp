@@ -2,6 +2,15 @@
 
 #include "CurlWrapper.h"
 
+#ifdef _WIN32
+# include <Windows.h>
+# include <bcrypt.h>
+# include <io.h>
+# pragma comment(lib, "bcrypt.lib")
+#else
+# include <unistd.h>
+#endif
+
 #ifdef _NDEBUG
 # define CHECK_CURL_EASY_SETOPT(handle, ...) CurlEasy::HandleOptionError(handle, curl_easy_setopt(handle->m_Handle, __VA_ARGS__), nullptr, 0)
 #else
@@ -51,12 +60,223 @@ static bool GetFileSize(FILE* file, curl_off_t* size)
     return false;
 }
 
+static FILE* OpenFile(const std::filesystem::path& path, const bool truncate)
+{
+    FILE* file = nullptr;
+#ifdef _WIN32
+    if (_wfopen_s(&file, path.c_str(), truncate ? L"w+b" : L"r+b") != 0) {
+        return nullptr;
+    }
+#else
+    file = fopen(path.c_str(), truncate ? "w+b" : "r+b");
+#endif
+    return file;
+}
+
+static bool TruncateFile(FILE* file)
+{
+    fflush(file);
+#ifdef _WIN32
+    const bool ok = _chsize_s(_fileno(file), 0) == 0;
+#else
+    const bool ok = ftruncate(fileno(file), 0) == 0;
+#endif
+    return ok && fseek(file, 0, SEEK_SET) == 0;
+}
+
+// Header names are ASCII and case-insensitive
+static bool EqualsNoCase(const std::string_view str, const std::string_view other)
+{
+    constexpr auto lower = [](const char c) {
+        return 'A' <= c && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    };
+    return std::ranges::equal(str, other, {}, lower, lower);
+}
+
+static std::string_view TrimHeaderValue(std::string_view value)
+{
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t' || value.back() == '\r' || value.back() == '\n')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+// Drops every "name: value" entry from the list; curl_slist can't remove in place, so the rest is copied over.
+static void RemoveHeader(curl_slist** headers, const std::string_view name)
+{
+    curl_slist* kept = nullptr;
+    bool removed = false;
+    for (const curl_slist* it = *headers; it; it = it->next) {
+        const std::string_view field(it->data);
+        const size_t colon = field.find(':');
+        if (colon != std::string_view::npos && EqualsNoCase(field.substr(0, colon), name)) {
+            removed = true;
+            continue;
+        }
+        kept = curl_slist_append(kept, it->data);
+    }
+    if (removed) {
+        curl_slist_free_all(*headers);
+        *headers = kept;
+    }
+    else {
+        curl_slist_free_all(kept);
+    }
+}
+
+// The ETag or Last-Modified of the file a ".part" belongs to lives next to it, so a later run can check with the
+// server that it's still the same file before resuming.
+static std::filesystem::path GetValidatorPath(const std::filesystem::path& path)
+{
+    auto validator_path = path;
+    validator_path += ".part.validator";
+    return validator_path;
+}
+
+static std::string ReadValidator(const std::filesystem::path& path)
+{
+    std::string validator;
+    FILE* file = OpenFile(GetValidatorPath(path), false);
+    if (!file) {
+        return validator;
+    }
+    char buffer[512];
+    const size_t read = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    if (read < sizeof(buffer)) {
+        validator.assign(TrimHeaderValue(std::string_view(buffer, read)));
+    }
+    return validator;
+}
+
+static bool WriteValidator(const std::filesystem::path& path, const std::string& validator)
+{
+    FILE* file = OpenFile(GetValidatorPath(path), true);
+    if (!file) {
+        return false;
+    }
+    const bool ok = fwrite(validator.data(), 1, validator.size(), file) == validator.size();
+    return fclose(file) == 0 && ok;
+}
+
+static void RemoveValidator(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    std::filesystem::remove(GetValidatorPath(path), ec);
+}
+
+// Reserves the disk space up front so a big download doesn't end up fragmented; the file size itself is left
+// alone, so an interrupted transfer still leaves a ".part" that's exactly as long as what we received.
+static void PreallocateFile(FILE* file, const curl_off_t size)
+{
+#ifdef _WIN32
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = size;
+    SetFileInformationByHandle(reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file))), FileAllocationInfo, &info, sizeof(info));
+#else
+    (void)file;
+    (void)size;
+#endif
+}
+
+// SHA-256 through the OS, no hashing on other platforms.
+static bool CreateHash(void** algorithm, void** hash)
+{
+#ifdef _WIN32
+    BCRYPT_ALG_HANDLE alg = nullptr;
+    BCRYPT_HASH_HANDLE h = nullptr;
+    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&alg, BCRYPT_SHA256_ALGORITHM, nullptr, 0))) {
+        return false;
+    }
+    if (!BCRYPT_SUCCESS(BCryptCreateHash(alg, &h, nullptr, 0, nullptr, 0, 0))) {
+        BCryptCloseAlgorithmProvider(alg, 0);
+        return false;
+    }
+    *algorithm = alg;
+    *hash = h;
+    return true;
+#else
+    (void)algorithm;
+    (void)hash;
+    return false;
+#endif
+}
+
+static void UpdateHash(void* hash, const void* data, const size_t size)
+{
+#ifdef _WIN32
+    if (hash) {
+        BCryptHashData(static_cast<BCRYPT_HASH_HANDLE>(hash), static_cast<PUCHAR>(const_cast<void*>(data)), static_cast<ULONG>(size), 0);
+    }
+#else
+    (void)hash;
+    (void)data;
+    (void)size;
+#endif
+}
+
+static std::string FinishHash(void* hash)
+{
+    std::string hex;
+#ifdef _WIN32
+    UCHAR digest[32];
+    if (hash && BCRYPT_SUCCESS(BCryptFinishHash(static_cast<BCRYPT_HASH_HANDLE>(hash), digest, sizeof(digest), 0))) {
+        static constexpr char digits[] = "0123456789abcdef";
+        for (const UCHAR b : digest) {
+            hex += digits[b >> 4];
+            hex += digits[b & 0xf];
+        }
+    }
+#else
+    (void)hash;
+#endif
+    return hex;
+}
+
+static void DestroyHash(void** algorithm, void** hash)
+{
+#ifdef _WIN32
+    if (*hash) {
+        BCryptDestroyHash(static_cast<BCRYPT_HASH_HANDLE>(*hash));
+    }
+    if (*algorithm) {
+        BCryptCloseAlgorithmProvider(static_cast<BCRYPT_ALG_HANDLE>(*algorithm), 0);
+    }
+#endif
+    *hash = nullptr;
+    *algorithm = nullptr;
+}
+
 static std::atomic<int> InitializeCount;
 
+// Every CurlEasy shares the DNS cache, TLS sessions and cookies, so requests to a host we already talked to skip
+// the lookup and most of the handshake. Connections aren't shared: each CurlMulti keeps its own pool, and a
+// shared pool would let a blocking Perform on one thread and the curl thread reach into the same connection.
+static CURLSH* ShareHandle;
+static std::mutex ShareMutexes[CURL_LOCK_DATA_LAST];
+
+static void ShareLock(CURL*, const curl_lock_data data, curl_lock_access, void*)
+{
+    ShareMutexes[data].lock();
+}
+
+static void ShareUnlock(CURL*, const curl_lock_data data, void*)
+{
+    ShareMutexes[data].unlock();
+}
+
 void InitCurl()
 {
     if (++InitializeCount == 1) {
         curl_global_init(CURL_GLOBAL_ALL);
+        ShareHandle = curl_share_init();
+        curl_share_setopt(ShareHandle, CURLSHOPT_LOCKFUNC, ShareLock);
+        curl_share_setopt(ShareHandle, CURLSHOPT_UNLOCKFUNC, ShareUnlock);
+        curl_share_setopt(ShareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(ShareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
     }
 }
 
@@ -64,6 +284,10 @@ void ShutdownCurl()
 {
     assert(InitializeCount > 0);
     if (--InitializeCount == 0) {
+        const CURLSHcode code = curl_share_cleanup(ShareHandle);
+        assert(code == CURLSHE_OK);
+        (void)code;
+        ShareHandle = nullptr;
         curl_global_cleanup();
     }
 }
@@ -72,6 +296,12 @@ CurlEasy::CurlEasy()
     : m_Headers(nullptr)
     , m_File(nullptr)
     , m_UploadFile(nullptr)
+    , m_DownloadFile(nullptr)
+    , m_DownloadOffset(0)
+    , m_DownloadWritten(0)
+    , m_DownloadSink(DownloadSink::Undecided)
+    , m_Hash(nullptr)
+    , m_HashAlgorithm(nullptr)
     , m_Status(ResponseStatus::None)
     , m_StatusCode(0)
     , m_MultiHandle(nullptr)
@@ -306,6 +536,141 @@ void CurlEasy::SetUploadFile(const char* path)
     }
 }
 
+bool CurlEasy::SetDownloadFile(const std::filesystem::path& path, const bool resume, const bool hash)
+{
+    CloseDownloadFile();
+    m_DownloadPath = path;
+    m_ContentHash.clear();
+    m_ResponseETag.clear();
+    m_ResponseLastModified.clear();
+    RemoveHeader(&m_Headers, "If-Range");
+    auto part = path;
+    part += ".part";
+
+    // Without a validator there's no telling whether the bytes we have still match the file on the server
+    m_DownloadValidator = resume ? ReadValidator(path) : std::string();
+    m_DownloadFile = !m_DownloadValidator.empty() ? OpenFile(part, false) : nullptr;
+    if (!m_DownloadFile) {
+        m_DownloadFile = OpenFile(part, true);
+    }
+    if (!m_DownloadFile) {
+        m_DownloadValidator.clear();
+        return false;
+    }
+    m_DownloadOffset = 0;
+    GetFileSize(m_DownloadFile, &m_DownloadOffset);
+    if (!m_DownloadOffset) {
+        m_DownloadValidator.clear();
+    }
+    if (m_DownloadValidator.empty()) {
+        RemoveValidator(path);
+    }
+    else {
+        // The server only honours the range if the file is unchanged, and sends all of it otherwise
+        SetHeader("If-Range", m_DownloadValidator.c_str());
+    }
+
+    if (hash && CreateHash(&m_HashAlgorithm, &m_Hash) && m_DownloadOffset) {
+        // The hash covers the whole file, so catch up on what the previous attempt wrote
+        char buffer[64 * 1024];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), m_DownloadFile)) > 0) {
+            UpdateHash(m_Hash, buffer, read);
+        }
+    }
+    fseek(m_DownloadFile, 0, SEEK_END);
+
+    m_DownloadWritten = 0;
+    m_DownloadSink = DownloadSink::Undecided;
+    // Not CURLOPT_RESUME_FROM_LARGE: curl fails the transfer when a resumed request gets the whole body, and we want
+    // that 200 to reach StartDownloadFile so it can start the ".part" over
+    const std::string range = m_DownloadOffset ? std::to_string(m_DownloadOffset) + "-" : std::string();
+    CHECK_CURL_EASY_SETOPT(this, CURLOPT_RANGE, range.empty() ? nullptr : range.c_str());
+    return true;
+}
+
+void CurlEasy::CloseDownloadFile()
+{
+    if (m_DownloadFile) {
+        fclose(m_DownloadFile);
+        m_DownloadFile = nullptr;
+    }
+    DestroyHash(&m_HashAlgorithm, &m_Hash);
+    m_DownloadSink = DownloadSink::Undecided;
+}
+
+bool CurlEasy::StartDownloadFile()
+{
+    long code = 0;
+    curl_easy_getinfo(m_Handle, CURLINFO_RESPONSE_CODE, &code);
+    if (code != 206) {
+        if (code < 200 || 300 <= code) {
+            return false; // Error page; keep it in memory for the caller and leave the ".part" alone
+        }
+        if (m_DownloadOffset) {
+            // Whole body after all, either because the file changed or the server ignores ranges; start over
+            if (!TruncateFile(m_DownloadFile)) {
+                return false;
+            }
+            m_DownloadOffset = 0;
+            if (m_Hash) {
+                DestroyHash(&m_HashAlgorithm, &m_Hash);
+                CreateHash(&m_HashAlgorithm, &m_Hash);
+            }
+        }
+        // Remember which file this is for a later resume; one the server can't identify is never resumed
+        const std::string& validator = !m_ResponseETag.empty() ? m_ResponseETag : m_ResponseLastModified;
+        if (validator.empty() || !WriteValidator(m_DownloadPath, validator)) {
+            RemoveValidator(m_DownloadPath);
+        }
+    }
+    curl_off_t length = -1;
+    if (curl_easy_getinfo(m_Handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) == CURLE_OK && length > 0) {
+        PreallocateFile(m_DownloadFile, m_DownloadOffset + length);
+    }
+    return true;
+}
+
+void CurlEasy::FinishDownloadFile(const int CurlStatus)
+{
+    if (!m_DownloadFile) {
+        return;
+    }
+    const bool answered = CurlStatus == CURLE_OK && 200 <= m_StatusCode && m_StatusCode < 300;
+    // A success without a single byte of body isn't a file we want to put in place
+    const bool empty_body = answered && m_DownloadSink == DownloadSink::Undecided;
+    const bool success = answered && m_DownloadSink == DownloadSink::File;
+    if (success && m_Hash) {
+        m_ContentHash = FinishHash(m_Hash);
+    }
+    CloseDownloadFile();
+    CHECK_CURL_EASY_SETOPT(this, CURLOPT_RANGE, static_cast<const char*>(nullptr));
+    RemoveHeader(&m_Headers, "If-Range");
+    m_DownloadValidator.clear();
+
+    auto part = m_DownloadPath;
+    part += ".part";
+    std::error_code ec;
+    if (success) {
+        std::filesystem::rename(part, m_DownloadPath, ec);
+        if (ec) {
+            m_Status = ResponseStatus::Error;
+            m_ContentHash.clear();
+        }
+        else {
+            RemoveValidator(m_DownloadPath);
+        }
+    }
+    else if (empty_body || CurlStatus == CURLE_RANGE_ERROR || m_StatusCode == 416 || !GetDownloadFileSize()) {
+        // Nothing worth resuming, or the server can't continue what we have; the next attempt starts from scratch
+        if (empty_body) {
+            m_Status = ResponseStatus::Error;
+        }
+        std::filesystem::remove(part, ec);
+        RemoveValidator(m_DownloadPath);
+    }
+}
+
 void CurlEasy::Clear()
 {
     m_Header.clear();
@@ -325,6 +690,7 @@ void CurlEasy::Reset()
         fclose(m_File);
         m_File = nullptr;
     }
+    CloseDownloadFile();
 
     m_UploadContent.clear();
     m_UploadBuffer.data = nullptr;
@@ -337,6 +703,7 @@ void CurlEasy::Reset()
     }
 
     curl_easy_reset(m_Handle);
+    CHECK_CURL_EASY_SETOPT(this, CURLOPT_SHARE, ShareHandle);
     CHECK_CURL_EASY_SETOPT(this, CURLOPT_WRITEFUNCTION, WriteCallback);
     CHECK_CURL_EASY_SETOPT(this, CURLOPT_WRITEDATA, this);
     CHECK_CURL_EASY_SETOPT(this, CURLOPT_HEADERFUNCTION, HeaderCallback);
@@ -396,6 +763,8 @@ void CurlEasy::UpdateStatus(const int CurlStatus)
             m_Status = ResponseStatus::Error;
             break;
     }
+
+    FinishDownloadFile(CurlStatus);
 }
 
 const char* CurlEasy::GetProtocolPrefix(const Protocol proto)
@@ -433,8 +802,46 @@ void CurlEasy::OnHeader(const char* bytes, const size_t count)
     m_Header.append(bytes, count);
 }
 
+void CurlEasy::OnDownloadHeader(const char* bytes, const size_t count)
+{
+    const std::string_view line(bytes, count);
+    if (line.starts_with("HTTP/")) {
+        // Status line of a new response, e.g. the one we were redirected to; only the last one counts
+        m_ResponseETag.clear();
+        m_ResponseLastModified.clear();
+        return;
+    }
+    const size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+        return;
+    }
+    const std::string_view name = line.substr(0, colon);
+    const std::string_view value = TrimHeaderValue(line.substr(colon + 1));
+    if (EqualsNoCase(name, "ETag")) {
+        // Weak ETags can't be used with If-Range
+        if (!value.starts_with("W/")) {
+            m_ResponseETag.assign(value);
+        }
+    }
+    else if (EqualsNoCase(name, "Last-Modified")) {
+        m_ResponseLastModified.assign(value);
+    }
+}
+
 void CurlEasy::OnContent(const char* bytes, const size_t count)
 {
+    if (m_DownloadFile && m_DownloadSink == DownloadSink::Undecided) {
+        m_DownloadSink = StartDownloadFile() ? DownloadSink::File : DownloadSink::Memory;
+    }
+    if (m_DownloadSink == DownloadSink::File) {
+        if (fwrite(bytes, 1, count, m_DownloadFile) != count) {
+            m_DownloadSink = DownloadSink::Failed; // Disk full or similar, WriteCallback aborts the transfer
+            return;
+        }
+        UpdateHash(m_Hash, bytes, count);
+        m_DownloadWritten += count;
+        return;
+    }
     m_Content.append(bytes, count);
 }
 
@@ -445,6 +852,9 @@ size_t CurlEasy::WriteCallback(const char* buffer, const size_t size, const size
     if (count / size == nitems) {
         easy->OnContent(buffer, count);
     }
+    if (easy->m_DownloadSink == DownloadSink::Failed) {
+        return 0;
+    }
     return count;
 }
 
@@ -454,6 +864,9 @@ size_t CurlEasy::HeaderCallback(const char* buffer, const size_t size, const siz
     const size_t count = size * nitems;
     assert(count / size == nitems);
     if (count / size == nitems) {
+        if (easy->m_DownloadFile) {
+            easy->OnDownloadHeader(buffer, count);
+        }
         easy->OnHeader(buffer, count);
     }
     return count;
@@ -528,6 +941,32 @@ void CurlMulti::Perform() const
     }
 }
 
+void CurlMulti::SetMaxHostConnections(const int amount) const
+{
+    curl_multi_setopt(m_Handle, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(amount));
+}
+
+void CurlMulti::SetMaxTotalConnections(const int amount) const
+{
+    curl_multi_setopt(m_Handle, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>(amount));
+}
+
+void CurlMulti::Poll(const int TimeoutMs) const
+{
+    const CURLMcode code = curl_multi_poll(m_Handle, nullptr, 0, TimeoutMs, nullptr);
+    if (code != CURLM_OK) {
+        fprintf(stderr, "Error in 'CurlMulti::Poll': %s\n", curl_multi_strerror(code));
+    }
+}
+
+void CurlMulti::Wakeup() const
+{
+    const CURLMcode code = curl_multi_wakeup(m_Handle);
+    if (code != CURLM_OK) {
+        fprintf(stderr, "Error in 'CurlMulti::Wakeup': %s\n", curl_multi_strerror(code));
+    }
+}
+
 void ComposeUrl(std::string& url, const char* host, const char* path)
 {
     url.append(host);
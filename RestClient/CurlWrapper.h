@@ -4,6 +4,7 @@
 #include <curl/curl.h>
 #include <stdint.h>
 #include <string>
+#include <filesystem>
 #include <initializer_list>
 
 #if defined(CURL_STRICTER)
@@ -91,6 +92,17 @@ public:
     void SetUploadFile(FILE* file, size_t size);
     void SetUploadFile(const char* path);
 
+    // Streams the response body to "path" instead of keeping it in memory; "GetContent" stays empty unless the
+    // server answers with an error, in which case the error page goes there instead of the file.
+    // The body is written to "path" + ".part" and only renamed to "path" once the transfer succeeded. With "resume",
+    // a ".part" left by an interrupted transfer is continued with a "Range: N-" request rather than started over, as
+    // long as the server gave us an ETag or Last-Modified for it; that's sent back as If-Range. If the file changed on
+    // the server in the meantime, or the server ignores ranges, the 200 with the whole body replaces the ".part" in the
+    // same transfer instead of being spliced onto the old bytes.
+    // With "hash", a SHA-256 of the whole file is computed while it's downloaded; see "GetContentHash".
+    // Needs to be called again before every transfer. Returns false if the file couldn't be opened.
+    bool SetDownloadFile(const std::filesystem::path& path, bool resume = true, bool hash = false);
+
     // Clear the response data and status flag
     void Clear();
 
@@ -103,6 +115,13 @@ public:
     std::string& GetHeader() { return m_Header; };
     std::string& GetContent() { return m_Content; }
 
+    // Bytes of the download file that were already on disk when the transfer (re)started.
+    curl_off_t GetResumeOffset() const { return m_DownloadOffset; }
+    // Bytes of the download file on disk so far, resumed part included.
+    curl_off_t GetDownloadFileSize() const { return m_DownloadOffset + m_DownloadWritten; }
+    // Lowercase hex SHA-256 of the download file; empty unless hashing was asked for and the transfer succeeded.
+    const std::string& GetContentHash() const { return m_ContentHash; }
+
     CURL* GetHandle() const { return m_Handle; }
     ResponseStatus GetStatus() const { return m_Status; }
     int GetStatusCode() const { return m_StatusCode; }
@@ -139,6 +158,14 @@ private:
     static size_t ReadFileCallback(char* buffer, size_t size, size_t nitems, void* userdata);
     static size_t ReadBufferCallback(char* buffer, size_t size, size_t nitems, void* userdata);
 
+    // Called on the first chunk of body; false if it isn't meant for the file.
+    bool StartDownloadFile();
+    // Called from "UpdateStatus" once the transfer is over; renames, keeps or deletes the ".part" file.
+    void FinishDownloadFile(int CurlStatus);
+    void CloseDownloadFile();
+    // Picks up ETag and Last-Modified from the response headers while a download file is set.
+    void OnDownloadHeader(const char* bytes, size_t count);
+
     // You are encouraged to re-write this function however you want, this
     // case represent the use cases of having a lot of hardcoded value where
     // an assert will catch all errors. Hence, we don't need to properly deal
@@ -158,6 +185,22 @@ protected:
     std::string m_UploadContent;
     UploadBuffer m_UploadBuffer;
 
+    // Set by "SetDownloadFile"; "m_DownloadFile" is closed on "Reset"
+    FILE* m_DownloadFile;
+    std::filesystem::path m_DownloadPath;
+    curl_off_t m_DownloadOffset;
+    curl_off_t m_DownloadWritten;
+    // Decided on the first chunk of body, once we know what the server answered
+    enum class DownloadSink { Undecided, File, Memory, Failed } m_DownloadSink;
+    // Validator of the ".part" we're resuming, sent as If-Range; empty when starting from scratch
+    std::string m_DownloadValidator;
+    // Validators of the response being received, saved next to the ".part" so it can be resumed later
+    std::string m_ResponseETag;
+    std::string m_ResponseLastModified;
+    void* m_Hash; // BCRYPT_HASH_HANDLE
+    void* m_HashAlgorithm; // BCRYPT_ALG_HANDLE
+    std::string m_ContentHash;
+
     // Those std::string can be replaced, but keep in mind that the small string optimisation
     // make those free if you don't use them (i.e. override OnHeader & OnContent) and that
     // they are prety good at growing.
@@ -193,6 +236,13 @@ public:
     void RemoveHandle(CurlEasy* Handle) const;
 
     void Perform() const;
+    // Transfers beyond these limits are queued by curl until a connection frees up; 0 means no limit.
+    void SetMaxHostConnections(int amount) const;
+    void SetMaxTotalConnections(int amount) const;
+    // Waits until there's activity on any of the transfers, a call to "Wakeup" or the timeout.
+    void Poll(int TimeoutMs) const;
+    // Makes a "Poll" in another thread return straight away; thread-safe.
+    void Wakeup() const;
 
 protected:
     CURLM* m_Handle;
@@ -5,116 +5,186 @@
 #include "RestClient.h"
 
 class CurlMultiThread : public Thread {
-    using Container = std::deque<AsyncRestClient*>;
+    // Be nice to the wikis; connections are kept alive and reused between requests to the same host.
+    static constexpr int MaxHostConnections = 6;
+    static constexpr int MaxTotalConnections = 32;
+
+    // Requests from other threads are queued and picked up by the curl thread the next time it wakes up,
+    // so submitting never waits for the transfers in progress.
+    struct Command {
+        enum class Type { Execute, Abort };
+
+        Type type;
+        AsyncRestClient* client;
+        // Only used by Abort; set once the curl thread let go of the client.
+        Event* done = nullptr;
+    };
 
 public:
     CurlMultiThread()
-        : m_pMulti(nullptr)
     {
         SetThreadName("CurlMultiThread");
     }
 
     void Start()
     {
+        std::lock_guard lock(m_CommandsMutex);
+        m_Multi = std::make_unique<CurlMulti>();
+        m_Multi->SetMaxHostConnections(MaxHostConnections);
+        m_Multi->SetMaxTotalConnections(MaxTotalConnections);
         m_Running = true;
         StartThread();
-
-        // @Remark:
-        // Not ideal, but we have to wait for 'm_pMulti' to be setted and it is in the thread.
-        // Otherwise, there is cases where 'CurlMultiThread::Execute' block.
-        while (!m_pMulti) {
-            Sleep(1);
-        }
     }
 
     void Stop()
     {
-        m_Running = false;
+        {
+            // Nothing gets queued past this point, so the queue drained below is final
+            std::lock_guard lock(m_CommandsMutex);
+            m_Running = false;
+            m_Multi->Wakeup();
+        }
         Join();
+
+        // The thread ran the commands it saw on its way out; fail whatever came in after that.
+        std::vector<Command> commands;
+        {
+            std::lock_guard lock(m_CommandsMutex);
+            commands.swap(m_Commands);
+            m_Multi.reset();
+        }
+        for (const Command& command : commands) {
+            switch (command.type) {
+                case Command::Type::Execute:
+                    command.client->OnCompletion(CURLE_ABORTED_BY_CALLBACK);
+                    break;
+                case Command::Type::Abort:
+                    command.done->SetDone();
+                    break;
+            }
+        }
     }
 
     void Execute(AsyncRestClient* pClient)
     {
-        std::lock_guard Lock(m_Mutex);
-        m_Clients.push_back(pClient);
-        m_pMulti->AddHandle(pClient);
+        {
+            std::lock_guard lock(m_CommandsMutex);
+            if (m_Running) {
+                m_Commands.push_back({Command::Type::Execute, pClient});
+                m_Multi->Wakeup();
+                return;
+            }
+        }
+        // InitAsyncRest wasn't called or we're shutting down; fail now rather than leave the caller waiting forever.
+        pClient->OnCompletion(CURLE_FAILED_INIT);
     }
 
+    // Blocks until the curl thread removed the request, so it's safe to destroy when this returns.
     void Abort(AsyncRestClient* pClient)
     {
-        std::lock_guard Lock(m_Mutex);
-        const auto it = Search(pClient);
-        if (it != m_Clients.end()) {
-            m_pMulti->RemoveHandle(pClient);
-            m_Clients.erase(it);
+        if (std::this_thread::get_id() == m_ThreadId) {
+            // e.g. from OnPerformed of another request
+            Remove(pClient);
+            return;
+        }
+        Event done(true, false);
+        {
+            std::unique_lock lock(m_CommandsMutex);
+            if (!m_Running) {
+                // Not started, stopped or stopping: nothing new reaches curl and whatever is left gets completed
+                // as aborted on the way out, so there's nothing to remove. Returns straight away unless the
+                // request is still being completed right now.
+                lock.unlock();
+                pClient->Wait();
+                return;
+            }
+            m_Commands.push_back({Command::Type::Abort, pClient, &done});
+            m_Multi->Wakeup();
         }
+        done.WaitUntilDone();
     }
 
 private:
     void Run() override
     {
-        CurlMulti m_Multi;
-        m_pMulti = &m_Multi;
+        m_ThreadId = std::this_thread::get_id();
 
         while (m_Running) {
-            {
-                std::lock_guard Lock(m_Mutex);
-                m_Multi.Perform();
-
-                int MsgsLeft;
-                const CURLMsg* pMsg = curl_multi_info_read(m_Multi.GetHandle(), &MsgsLeft);
-                while (pMsg) {
-                    AsyncRestClient* pClient = SearchPop(pMsg->easy_handle);
-                    m_Multi.RemoveHandle(pClient);
+            RunCommands();
+            m_Multi->Perform();
+
+            int MsgsLeft;
+            const CURLMsg* pMsg = curl_multi_info_read(m_Multi->GetHandle(), &MsgsLeft);
+            while (pMsg) {
+                const auto it = pMsg->msg == CURLMSG_DONE ? m_Clients.find(pMsg->easy_handle) : m_Clients.end();
+                if (it != m_Clients.end()) {
+                    AsyncRestClient* pClient = it->second;
+                    m_Clients.erase(it);
+                    m_Multi->RemoveHandle(pClient);
                     pClient->OnCompletion(pMsg->data.result);
-
-                    pMsg = curl_multi_info_read(m_Multi.GetHandle(), &MsgsLeft);
                 }
+
+                pMsg = curl_multi_info_read(m_Multi->GetHandle(), &MsgsLeft);
             }
 
-            Sleep(16);
+            // Returns as soon as a transfer needs attention, curl has a timeout to handle or a command wakes us up.
+            m_Multi->Poll(1000);
         }
 
-        m_pMulti = nullptr;
-    }
-
-    Container::iterator Search(const CURL* pHandle)
-    {
-        Container::iterator it;
-        for (it = m_Clients.begin(); it != m_Clients.end(); ++it) {
-            if ((*it)->GetHandle() == pHandle) {
-                break;
-            }
+        // Release anyone still waiting on an abort, then fail whatever didn't finish.
+        RunCommands();
+        while (!m_Clients.empty()) {
+            AsyncRestClient* pClient = m_Clients.begin()->second;
+            m_Clients.erase(m_Clients.begin());
+            m_Multi->RemoveHandle(pClient);
+            pClient->OnCompletion(CURLE_ABORTED_BY_CALLBACK);
         }
-        return it;
     }
 
-    Container::iterator Search(const AsyncRestClient* pClient)
+    void RunCommands()
     {
-        Container::iterator it;
-        for (it = m_Clients.begin(); it != m_Clients.end(); ++it) {
-            if (*it == pClient) {
-                break;
+        {
+            std::lock_guard lock(m_CommandsMutex);
+            m_Pending.swap(m_Commands);
+        }
+        for (const Command& command : m_Pending) {
+            switch (command.type) {
+                case Command::Type::Execute:
+                    if (m_Running) {
+                        m_Clients.emplace(command.client->GetHandle(), command.client);
+                        m_Multi->AddHandle(command.client);
+                    }
+                    else {
+                        command.client->OnCompletion(CURLE_ABORTED_BY_CALLBACK);
+                    }
+                    break;
+                case Command::Type::Abort:
+                    Remove(command.client);
+                    command.done->SetDone(); // done lives on the aborting thread's stack, don't touch it after this
+                    break;
             }
         }
-        return it;
+        m_Pending.clear();
     }
 
-    AsyncRestClient* SearchPop(const CURL* pHandle)
+    void Remove(AsyncRestClient* pClient)
     {
-        const auto it = Search(pHandle);
-        if (it == m_Clients.end()) {
-            return nullptr;
+        const auto it = m_Clients.find(pClient->GetHandle());
+        if (it != m_Clients.end()) {
+            m_Multi->RemoveHandle(pClient);
+            m_Clients.erase(it);
         }
-        AsyncRestClient* pClient = *it;
-        m_Clients.erase(it);
-        return pClient;
     }
 
-    Container m_Clients;
-    CurlMulti* m_pMulti;
+    // Only touched by the curl thread
+    std::unordered_map<CURL*, AsyncRestClient*> m_Clients;
+    std::vector<Command> m_Pending; // Kept to reuse its capacity
+    // Guards m_Commands, and m_Running and m_Multi against Start/Stop while a command is queued
+    std::mutex m_CommandsMutex;
+    std::vector<Command> m_Commands;
+    std::unique_ptr<CurlMulti> m_Multi;
     std::atomic<bool> m_Running;
-    std::recursive_mutex m_Mutex;
+    std::atomic<std::thread::id> m_ThreadId;
 };
 
 static CurlMultiThread s_RestThread;